@@ -0,0 +1,803 @@
+// Copyright (c) 2022 Mohammad Nejati
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include <oneshot.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/channel.hpp>
+#include <boost/asio/experimental/concurrent_channel.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace asio = boost::asio;
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+template<std::size_t N>
+struct payload
+{
+    std::array<char, N> data{};
+};
+
+template<typename T>
+constexpr std::string_view payload_name = "";
+template<>
+constexpr std::string_view payload_name<void> = "void";
+template<>
+constexpr std::string_view payload_name<int> = "int";
+template<>
+constexpr std::string_view payload_name<payload<64>> = "64B";
+template<>
+constexpr std::string_view payload_name<payload<1024>> = "1KiB";
+
+template<typename T>
+inline void
+do_not_optimize(T&& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template<typename F>
+void
+run(std::string_view name, std::string_view payload, std::size_t iterations, F f)
+{
+    f(iterations / 10 + 1); // warm-up
+
+    auto start   = clock_type::now();
+    f(iterations);
+    auto elapsed = clock_type::now() - start;
+
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::printf(
+        "%-56.*s %-6.*s %10.1f ns/op %10.2f Mop/s\n",
+        static_cast<int>(name.size()),
+        name.data(),
+        static_cast<int>(payload.size()),
+        payload.data(),
+        ns / iterations,
+        iterations / ns * 1e3);
+}
+
+// runs an io_context on a dedicated thread for the lifetime of the object
+class context_thread
+{
+    asio::io_context ctx_{ 1 };
+    asio::executor_work_guard<asio::io_context::executor_type> work_{
+        ctx_.get_executor()
+    };
+    std::thread thread_{ [this] { ctx_.run(); } };
+
+  public:
+    ~context_thread()
+    {
+        work_.reset();
+        thread_.join();
+    }
+
+    asio::io_context&
+    context() noexcept
+    {
+        return ctx_;
+    }
+};
+
+template<typename T, typename Policy>
+void
+send_to(oneshot::sender<T, Policy>& s)
+{
+    if constexpr (std::is_void_v<T>)
+        s.send();
+    else
+        s.send(T{});
+}
+
+template<typename T, typename Policy>
+auto
+create_pair()
+{
+    if constexpr (std::is_same_v<Policy, oneshot::single_threaded>)
+        return oneshot::local::create<T>();
+    else
+        return oneshot::create<T>();
+}
+
+// --- oneshot -----------------------------------------------------------------
+
+template<typename T>
+void
+bench_create(std::size_t iterations)
+{
+    run(
+        "oneshot::create",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto pair = oneshot::create<T>();
+                do_not_optimize(pair);
+            }
+        });
+}
+
+template<typename T>
+void
+bench_pooled_create(std::size_t iterations)
+{
+    run(
+        "oneshot::pooled_create",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto pair = oneshot::pooled_create<T>();
+                do_not_optimize(pair);
+            }
+        });
+}
+
+// per pair, in fan-outs of 64
+template<typename T>
+void
+bench_create_n(std::size_t iterations)
+{
+    run(
+        "oneshot::create_n (64)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i += 64)
+            {
+                auto pairs = oneshot::create_n<T>(64);
+                do_not_optimize(pairs);
+            }
+        });
+}
+
+template<typename T>
+void
+bench_send(std::size_t iterations)
+{
+    run(
+        "oneshot::sender::send",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto [s, r] = oneshot::create<T>();
+                send_to(s);
+                do_not_optimize(r.is_ready());
+            }
+        });
+}
+
+template<typename T, typename Policy = oneshot::thread_safe>
+void
+bench_async_wait(std::size_t iterations)
+{
+    run(
+        std::is_same_v<Policy, oneshot::single_threaded>
+            ? "oneshot::local::async_wait (same thread)"
+            : "oneshot::async_wait (same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx  = asio::io_context{ 1 };
+            auto work = asio::make_work_guard(ctx);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto [s, r] = create_pair<T, Policy>();
+                r.async_wait(asio::bind_executor(ctx, [](auto) {}));
+                send_to(s);
+                ctx.poll_one();
+            }
+        });
+}
+
+// one shared state reused through receiver::reset for every round
+template<typename T>
+void
+bench_async_wait_reset(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait (reset, same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx    = asio::io_context{ 1 };
+            auto work   = asio::make_work_guard(ctx);
+            auto [s, r] = oneshot::create<T>();
+            for (std::size_t i = 0; i < n; i++)
+            {
+                r.async_wait(asio::bind_executor(ctx, [](auto) {}));
+                send_to(s);
+                ctx.poll_one();
+                s = r.reset();
+            }
+        });
+}
+
+// every wait is cancelled and made again on the same receiver
+template<typename T>
+void
+bench_async_wait_cancel(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait (cancelled, same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx    = asio::io_context{ 1 };
+            auto work   = asio::make_work_guard(ctx);
+            auto [s, r] = oneshot::create<T>();
+            auto cs     = asio::cancellation_signal{};
+            for (std::size_t i = 0; i < n; i++)
+            {
+                r.async_wait(asio::bind_cancellation_slot(
+                    cs.slot(), asio::bind_executor(ctx, [](auto) {})));
+                cs.emit(asio::cancellation_type::total);
+                ctx.poll_one();
+            }
+        });
+}
+
+template<typename T>
+void
+bench_async_wait_dispatch(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait dispatch (within executor)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx = asio::io_context{ 1 };
+            asio::post(
+                ctx,
+                [&]
+                {
+                    for (std::size_t i = 0; i < n; i++)
+                    {
+                        auto [s, r] = oneshot::create<T>();
+                        r.async_wait(
+                            oneshot::completion_mode::dispatch,
+                            asio::bind_executor(ctx, [](auto) {}));
+                        send_to(s);
+                    }
+                });
+            ctx.run();
+        });
+}
+
+template<typename T>
+void
+bench_async_extract(std::size_t iterations)
+{
+    run(
+        "oneshot::async_extract (same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx  = asio::io_context{ 1 };
+            auto work = asio::make_work_guard(ctx);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto [s, r] = oneshot::create<T>();
+                std::move(r).async_extract(
+                    asio::bind_executor(ctx, [](auto&&...) {}));
+                send_to(s);
+                ctx.poll_one();
+            }
+        });
+}
+
+// per receiver, in groups of 64
+template<typename T>
+void
+bench_async_wait_all(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait_all (64)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx  = asio::io_context{ 1 };
+            auto work = asio::make_work_guard(ctx);
+            for (std::size_t i = 0; i < n; i += 64)
+            {
+                auto [ss, rs] = oneshot::create_n<T>(64);
+                oneshot::async_wait_all(
+                    rs, asio::bind_executor(ctx, [](auto) {}));
+                for (auto& s : ss)
+                    send_to(s);
+                ctx.poll_one();
+            }
+        });
+}
+
+// per receiver, 64 sends through a batch complete with one post
+template<typename T>
+void
+bench_send_batch(std::size_t iterations)
+{
+    run(
+        "oneshot::send_batch (64)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx     = asio::io_context{ 1 };
+            auto work    = asio::make_work_guard(ctx);
+            auto handler = asio::bind_executor(ctx, [](auto) {});
+            for (std::size_t i = 0; i < n; i += 64)
+            {
+                auto [ss, rs] = oneshot::create_n<T>(64);
+                for (auto& r : rs)
+                    r.async_wait(handler);
+                {
+                    auto batch = oneshot::send_batch{};
+                    for (auto& s : ss)
+                    {
+                        if constexpr (std::is_void_v<T>)
+                            batch.send(s);
+                        else
+                            batch.send(s, T{});
+                    }
+                }
+                ctx.poll_one();
+            }
+        });
+}
+
+// Each round sends a request to a receiver waiting on thread B, whose
+// completion handler replies through a second oneshot waited on thread A.
+// `Placed` allocates each state from the pool of the context waiting on it.
+template<typename T, bool Placed = false>
+struct oneshot_ping_pong
+{
+    asio::io_context& a;
+    asio::io_context& b;
+    std::size_t remaining;
+    std::promise<void> done;
+    oneshot::receiver<T> request{};
+    oneshot::receiver<T> reply{};
+
+    void
+    round()
+    {
+        if (remaining-- == 0)
+            return done.set_value();
+
+        auto create = [](asio::io_context& waiter)
+        {
+            if constexpr (Placed)
+                return oneshot::create<T>(
+                    oneshot::context_allocator<T>{ waiter.get_executor() });
+            else
+                return oneshot::create<T>();
+        };
+        auto [s1, r1] = create(b);
+        auto [s2, r2] = create(a);
+        request       = std::move(r1);
+        reply         = std::move(r2);
+
+        reply.async_wait(asio::bind_executor(a, [this](auto) { round(); }));
+        request.async_wait(asio::bind_executor(
+            b, [s2 = std::move(s2)](auto) mutable { send_to(s2); }));
+
+        send_to(s1);
+    }
+};
+
+template<typename T>
+void
+bench_cross_thread(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait (cross thread hop)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto a  = context_thread{};
+            auto b  = context_thread{};
+            auto pp = oneshot_ping_pong<T>{ a.context(), b.context(), n / 2, {} };
+            auto f  = pp.done.get_future();
+            asio::post(a.context(), [&] { pp.round(); });
+            f.wait();
+        });
+}
+
+// as above, with states placed in pools filled from the waiting threads,
+// which on NUMA machines keeps each state on the node of its waiter
+template<typename T>
+void
+bench_cross_thread_placed(std::size_t iterations)
+{
+    run(
+        "oneshot::async_wait (cross thread hop, context pools)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto a = context_thread{};
+            auto b = context_thread{};
+            for (auto* ctx : { &a.context(), &b.context() })
+            {
+                auto alloc =
+                    oneshot::context_allocator<T>{ ctx->get_executor() };
+                asio::post(*ctx, [alloc] { alloc.reserve_states(16); });
+            }
+
+            auto pp = oneshot_ping_pong<T, true>{
+                a.context(), b.context(), n / 2, {}
+            };
+            auto f = pp.done.get_future();
+            asio::post(a.context(), [&] { pp.round(); });
+            f.wait();
+        });
+}
+
+// the ping-pong of the std::promise baseline, through blocking waits
+template<typename T>
+void
+bench_blocking_wait(std::size_t iterations)
+{
+    run(
+        "oneshot::receiver::wait (cross thread hop)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto rounds   = n / 2;
+            auto requests = oneshot::create_n<T>(rounds);
+            auto replies  = oneshot::create_n<T>(rounds);
+
+            auto t = std::thread{ [&]
+                                  {
+                                      for (std::size_t i = 0; i < rounds; i++)
+                                      {
+                                          requests.second[i].wait();
+                                          send_to(replies.first[i]);
+                                      }
+                                  } };
+            for (std::size_t i = 0; i < rounds; i++)
+            {
+                send_to(requests.first[i]);
+                replies.second[i].wait();
+            }
+            t.join();
+        });
+}
+
+// Two threads send to interleaved states of one create_n block, so that with
+// the packed layout neighbouring states written from different cores share a
+// cache line.
+template<typename T, bool Padded>
+void
+bench_interleaved_send(std::size_t iterations)
+{
+    run(
+        Padded ? "oneshot::create_n padded (interleaved cross-core send)"
+               : "oneshot::create_n packed (interleaved cross-core send)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto pairs = [&]
+            {
+                if constexpr (Padded)
+                    return oneshot::create_n<T>(n, oneshot::padded);
+                else
+                    return oneshot::create_n<T>(n);
+            }();
+            auto go      = std::atomic<bool>{ false };
+            auto threads = std::vector<std::thread>{};
+            for (std::size_t first = 0; first < 2; first++)
+                threads.emplace_back(
+                    [&, first]
+                    {
+                        while (!go.load(std::memory_order_acquire))
+                            ;
+                        for (auto i = first; i < n; i += 2)
+                            send_to(pairs.first[i]);
+                    });
+            go.store(true, std::memory_order_release);
+            for (auto& t : threads)
+                t.join();
+        });
+}
+
+// --- baselines ---------------------------------------------------------------
+
+template<typename T>
+void
+set_promise(std::promise<T>& p)
+{
+    if constexpr (std::is_void_v<T>)
+        p.set_value();
+    else
+        p.set_value(T{});
+}
+
+template<typename T>
+void
+bench_promise(std::size_t iterations, std::size_t cross_iterations)
+{
+    run(
+        "std::promise/future (same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                auto p = std::promise<T>{};
+                auto f = p.get_future();
+                set_promise(p);
+                f.get();
+            }
+        });
+
+    run(
+        "std::promise/future (cross thread hop)",
+        payload_name<T>,
+        cross_iterations,
+        [](std::size_t n)
+        {
+            auto rounds   = n / 2;
+            auto requests = std::vector<std::promise<T>>(rounds);
+            auto replies  = std::vector<std::promise<T>>(rounds);
+            auto request_futures = std::vector<std::future<T>>{};
+            auto reply_futures   = std::vector<std::future<T>>{};
+            for (std::size_t i = 0; i < rounds; i++)
+            {
+                request_futures.push_back(requests[i].get_future());
+                reply_futures.push_back(replies[i].get_future());
+            }
+
+            auto t = std::thread{ [&]
+                                  {
+                                      for (std::size_t i = 0; i < rounds; i++)
+                                      {
+                                          request_futures[i].get();
+                                          set_promise(replies[i]);
+                                      }
+                                  } };
+            for (std::size_t i = 0; i < rounds; i++)
+            {
+                set_promise(requests[i]);
+                reply_futures[i].get();
+            }
+            t.join();
+        });
+}
+
+template<typename T>
+using channel_value_t = std::conditional_t<std::is_void_v<T>, int, T>;
+
+template<typename T>
+using channel_type = asio::experimental::channel<
+    void(boost::system::error_code, channel_value_t<T>)>;
+
+template<typename T>
+using concurrent_channel_type = asio::experimental::concurrent_channel<
+    void(boost::system::error_code, channel_value_t<T>)>;
+
+template<typename T>
+struct channel_ping_pong
+{
+    concurrent_channel_type<T> request;
+    concurrent_channel_type<T> reply;
+    std::size_t remaining;
+    std::promise<void> done;
+
+    channel_ping_pong(
+        asio::io_context& a,
+        asio::io_context& b,
+        std::size_t rounds)
+        : request{ b, 1 }
+        , reply{ a, 1 }
+        , remaining{ rounds }
+    {
+    }
+
+    void
+    serve()
+    {
+        request.async_receive(
+            [this](auto ec, auto v)
+            {
+                if (ec)
+                    return;
+                reply.try_send(ec, std::move(v));
+                serve();
+            });
+    }
+
+    void
+    round()
+    {
+        if (remaining-- == 0)
+            return done.set_value();
+
+        reply.async_receive([this](auto, auto) { round(); });
+        request.try_send(boost::system::error_code{}, channel_value_t<T>{});
+    }
+};
+
+template<typename T>
+void
+bench_channel(std::size_t iterations, std::size_t cross_iterations)
+{
+    run(
+        "asio::experimental::channel (same thread)",
+        payload_name<T>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx  = asio::io_context{ 1 };
+            auto work = asio::make_work_guard(ctx);
+            auto ch   = channel_type<T>{ ctx, 1 };
+            for (std::size_t i = 0; i < n; i++)
+            {
+                ch.async_receive([](auto, auto) {});
+                ch.try_send(boost::system::error_code{}, channel_value_t<T>{});
+                ctx.poll_one();
+            }
+        });
+
+    run(
+        "asio::experimental::concurrent_channel (cross thread hop)",
+        payload_name<T>,
+        cross_iterations,
+        [](std::size_t n)
+        {
+            auto a  = context_thread{};
+            auto b  = context_thread{};
+            auto pp = channel_ping_pong<T>{ a.context(), b.context(), n / 2 };
+            auto f  = pp.done.get_future();
+            asio::post(b.context(), [&] { pp.serve(); });
+            asio::post(a.context(), [&] { pp.round(); });
+            f.wait();
+            asio::post(b.context(), [&] { pp.request.close(); });
+        });
+}
+
+// Signalling by cancelling a timer that never expires; the timer is not
+// thread-safe, so a cross-thread signal has to be posted to its context.
+struct timer_ping_pong
+{
+    asio::steady_timer request;
+    asio::steady_timer reply;
+    std::size_t remaining;
+    std::promise<void> done;
+
+    timer_ping_pong(
+        asio::io_context& a,
+        asio::io_context& b,
+        std::size_t rounds)
+        : request{ b, asio::steady_timer::time_point::max() }
+        , reply{ a, asio::steady_timer::time_point::max() }
+        , remaining{ rounds }
+    {
+    }
+
+    void
+    round()
+    {
+        if (remaining-- == 0)
+            return done.set_value();
+
+        reply.async_wait([this](auto) { round(); });
+        asio::post(
+            request.get_executor(),
+            [this]
+            {
+                request.async_wait(
+                    [this](auto)
+                    {
+                        asio::post(
+                            reply.get_executor(), [this] { reply.cancel(); });
+                    });
+                request.cancel();
+            });
+    }
+};
+
+void
+bench_steady_timer(std::size_t iterations, std::size_t cross_iterations)
+{
+    run(
+        "asio::steady_timer signal (same thread)",
+        payload_name<void>,
+        iterations,
+        [](std::size_t n)
+        {
+            auto ctx   = asio::io_context{ 1 };
+            auto work  = asio::make_work_guard(ctx);
+            auto timer = asio::steady_timer{
+                ctx, asio::steady_timer::time_point::max()
+            };
+            for (std::size_t i = 0; i < n; i++)
+            {
+                timer.async_wait([](auto) {});
+                timer.cancel();
+                ctx.poll_one();
+            }
+        });
+
+    run(
+        "asio::steady_timer signal (cross thread hop)",
+        payload_name<void>,
+        cross_iterations,
+        [](std::size_t n)
+        {
+            auto a  = context_thread{};
+            auto b  = context_thread{};
+            auto pp = timer_ping_pong{ a.context(), b.context(), n / 2 };
+            auto f  = pp.done.get_future();
+            asio::post(a.context(), [&] { pp.round(); });
+            f.wait();
+        });
+}
+
+template<typename T>
+void
+bench_payload(std::size_t iterations, std::size_t cross_iterations)
+{
+    bench_create<T>(iterations);
+    bench_pooled_create<T>(iterations);
+    bench_create_n<T>(iterations);
+    bench_send<T>(iterations);
+    bench_async_wait<T>(iterations);
+    bench_async_wait<T, oneshot::single_threaded>(iterations);
+    bench_async_wait_reset<T>(iterations);
+    bench_async_wait_cancel<T>(iterations);
+    bench_async_wait_dispatch<T>(iterations);
+    bench_async_extract<T>(iterations);
+    bench_async_wait_all<T>(iterations);
+    bench_send_batch<T>(iterations);
+    bench_cross_thread<T>(cross_iterations);
+    bench_cross_thread_placed<T>(cross_iterations);
+    bench_blocking_wait<T>(cross_iterations);
+    bench_interleaved_send<T, false>(cross_iterations);
+    bench_interleaved_send<T, true>(cross_iterations);
+    bench_promise<T>(iterations, cross_iterations);
+    bench_channel<T>(iterations, cross_iterations);
+    std::printf("\n");
+}
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+    std::size_t iterations = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+    std::size_t cross_iterations = iterations / 10;
+
+    bench_payload<void>(iterations, cross_iterations);
+    bench_payload<int>(iterations, cross_iterations);
+    bench_payload<payload<64>>(iterations, cross_iterations);
+    bench_payload<payload<1024>>(iterations, cross_iterations);
+    bench_steady_timer(iterations, cross_iterations);
+}
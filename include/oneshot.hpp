@@ -4,16 +4,50 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <optional>
+#include <span>
+#include <system_error>
 #include <utility>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<sys/eventfd.h>)
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define ONESHOT_HAS_EVENTFD
+#endif
 
 #ifdef ONESHOT_ASIO_STANDALONE
 #include <asio/append.hpp>
 #include <asio/associated_cancellation_slot.hpp>
-#include <asio/compose.hpp>
 #include <asio/deferred.hpp>
+#include <asio/dispatch.hpp>
+#include <asio/execution/context.hpp>
+#include <asio/execution_context.hpp>
 #include <asio/post.hpp>
+#include <asio/query.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/version.hpp>
+#if ASIO_VERSION >= 102800
+#include <asio/associated_immediate_executor.hpp>
+#define ONESHOT_HAS_IMMEDIATE_EXECUTOR
+#endif
 namespace oneshot
 {
 namespace net    = asio;
@@ -22,9 +56,18 @@ using error_code = std::error_code;
 #else
 #include <boost/asio/append.hpp>
 #include <boost/asio/associated_cancellation_slot.hpp>
-#include <boost/asio/compose.hpp>
 #include <boost/asio/deferred.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/execution/context.hpp>
+#include <boost/asio/execution_context.hpp>
 #include <boost/asio/post.hpp>
+#include <boost/asio/query.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/version.hpp>
+#if BOOST_ASIO_VERSION >= 102800
+#include <boost/asio/associated_immediate_executor.hpp>
+#define ONESHOT_HAS_IMMEDIATE_EXECUTOR
+#endif
 namespace oneshot
 {
 namespace net    = boost::asio;
@@ -32,6 +75,22 @@ using error_code = boost::system::error_code;
 } // namespace oneshot
 #endif
 
+// Size of the storage reserved next to each shared state for constructing a
+// wait operation in place, handlers that don't fit are allocated through their
+// associated allocator. The default holds a wait whose handler is bound to an
+// any_io_executor, or a timed wait bound to an io_context. Zero disables the
+// storage.
+#ifndef ONESHOT_WAIT_OP_BUFFER_SIZE
+#define ONESHOT_WAIT_OP_BUFFER_SIZE 128
+#endif
+
+// Alignment of padded shared states, a common destructive interference size
+// rather than std::hardware_destructive_interference_size, which is allowed
+// to differ between translation units.
+#ifndef ONESHOT_CACHE_LINE_SIZE
+#define ONESHOT_CACHE_LINE_SIZE 64
+#endif
+
 namespace oneshot
 {
 enum class errc
@@ -41,6 +100,7 @@ enum class errc
     unready,
     broken_sender,
     duplicate_wait_on_receiver,
+    timeout,
 };
 } // namespace oneshot
 
@@ -80,6 +140,8 @@ oneshot_category()
                     return "Broken sender";
                 case errc::duplicate_wait_on_receiver:
                     return "Duplicate wait on receiver";
+                case errc::timeout:
+                    return "Timeout";
                 default:
                     return "Unknown error";
             }
@@ -101,523 +163,5412 @@ class error : public std::system_error
     using std::system_error::system_error;
 };
 
-namespace detail
+// Tag for creating shared states aligned to ONESHOT_CACHE_LINE_SIZE, so that
+// states allocated back to back don't share a cache line.
+struct padded_t
 {
-struct wait_op
+    explicit padded_t() = default;
+};
+
+inline constexpr padded_t padded{};
+
+// Specialize as std::true_type to store values of a trivially copyable type
+// smaller than 8 bytes in the state word, so sending one is a single atomic
+// operation. receiver::get() then returns a copy instead of a reference.
+template<typename T>
+struct pack_into_state : std::false_type
 {
-    virtual void
-    shutdown() noexcept               = 0;
-    virtual void complete(error_code) = 0;
-    virtual ~wait_op()                = default;
 };
 
-template<class Executor, class Handler>
-class wait_op_model final : public wait_op
+// How a wait is completed when the sender side finishes it.
+enum class completion_mode
 {
-    net::executor_work_guard<Executor> work_guard_;
-    Handler handler_;
+    post,     // always post to the handler's executor
+    dispatch, // run inline if send() is called from within that executor
+};
+
+namespace detail
+{
+template<typename T>
+class unsynchronized_atomic
+{
+    T value_;
 
   public:
-    wait_op_model(Executor e, Handler handler)
-        : work_guard_(std::move(e))
-        , handler_(std::move(handler))
+    constexpr unsynchronized_atomic(T value) noexcept
+        : value_{ value }
     {
     }
 
-    [[nodiscard]] auto
-    get_cancellation_slot() const noexcept
+    T
+    load(std::memory_order) const noexcept
     {
-        return net::get_associated_cancellation_slot(handler_);
+        return value_;
     }
 
-    static wait_op_model*
-    construct(Executor e, Handler handler)
+    void
+    store(T value, std::memory_order) noexcept
     {
-        auto halloc = net::get_associated_allocator(handler);
-        auto alloc  = typename std::allocator_traits<
-            decltype(halloc)>::template rebind_alloc<wait_op_model>(halloc);
-        using traits = std::allocator_traits<decltype(alloc)>;
-        auto pmem    = traits::allocate(alloc, 1);
+        value_ = value;
+    }
 
-        try
-        {
-            return new (pmem) wait_op_model(std::move(e), std::move(handler));
-        }
-        catch (...)
-        {
-            traits::deallocate(alloc, pmem, 1);
-            throw;
-        }
+    T
+    exchange(T value, std::memory_order) noexcept
+    {
+        return std::exchange(value_, value);
     }
 
-    static void
-    destroy(wait_op_model* self, net::associated_allocator_t<Handler> halloc)
+    T
+    fetch_add(T value, std::memory_order) noexcept
     {
-        auto alloc = typename std::allocator_traits<
-            decltype(halloc)>::template rebind_alloc<wait_op_model>(halloc);
-        self->~wait_op_model();
-        auto traits = std::allocator_traits<decltype(alloc)>();
-        traits.deallocate(alloc, self, 1);
+        return std::exchange(value_, value_ + value);
     }
 
-    void
-    complete(error_code ec) override
+    T
+    fetch_sub(T value, std::memory_order) noexcept
     {
-        net::post(
-            work_guard_.get_executor(),
-            [this, ec]()
-            {
-                get_cancellation_slot().clear();
-                auto g = std::move(work_guard_);
-                auto h = std::move(handler_);
-                destroy(this, net::get_associated_allocator(h));
-                std::move(h)(ec);
-            });
+        return std::exchange(value_, value_ - value);
     }
 
-    void
-    shutdown() noexcept override
+    bool
+    compare_exchange_strong(
+        T& expected,
+        T desired,
+        std::memory_order,
+        std::memory_order) noexcept
     {
-        get_cancellation_slot().clear();
-        destroy(this, net::get_associated_allocator(this->handler_));
+        if (value_ != expected)
+        {
+            expected = value_;
+            return false;
+        }
+        value_ = desired;
+        return true;
     }
 };
+} // namespace detail
 
-template<typename T>
-struct storage;
-
-template<>
-struct storage<void>
+// Points of the shared state life cycle reported to the instrumentation.
+enum class trace_event : uint8_t
 {
-    void
-    construct() noexcept
-    {
-    }
+    create,            // a shared state has been allocated
+    send,              // the sender side has stored the value
+    wait,              // a wait has been registered with a shared state
+    post,              // a wait operation has handed its completion over
+    invoke,            // a completion handler is about to run
+    cancel,            // a pending wait has been cancelled or withdrawn
+    broken_sender,     // the sender has been destroyed without sending
+    receiver_detached, // the receiver has been destroyed
+};
 
-    void
-    destroy() noexcept
-    {
-    }
+using trace_clock = std::chrono::steady_clock;
 
-    void*
-    object() noexcept
-    {
-        return nullptr;
-    }
+struct trace_record
+{
+    trace_event event;
+    // the shared state, or the wait operation for post and invoke
+    const void* id;
+    trace_clock::time_point time;
+    error_code ec;
+    // for invoke, when the sender side completed the wait and when the
+    // completion was handed over
+    trace_clock::time_point signalled;
+    trace_clock::time_point posted;
 };
 
-template<typename T>
-struct storage
+// Instrumentation keeping per-thread latency histograms and counters, enabled
+// with `#define ONESHOT_INSTRUMENTATION oneshot::latency_recorder` before
+// including this header.
+class latency_recorder
 {
-    alignas(T) char payload_[sizeof(T)];
+    using counter = std::atomic<std::uint64_t>;
 
-    template<typename... Args>
-    void
-    construct(Args&&... args)
+    // written by the owning thread only
+    static void
+    bump(counter& c) noexcept
     {
-        new (&payload_) T(std::forward<Args>(args)...);
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
 
-    void
-    destroy() noexcept
+  public:
+    // log2 buckets of nanoseconds
+    struct histogram
     {
-        std::destroy_at(object());
-    }
+        std::array<std::uint64_t, 64> buckets{};
 
-    T*
-    object() noexcept
-    {
-        return std::launder(reinterpret_cast<T*>(&payload_));
-    }
-};
+        std::uint64_t
+        count() const noexcept
+        {
+            auto n = std::uint64_t{ 0 };
+            for (auto b : buckets)
+                n += b;
+            return n;
+        }
 
-template<typename T>
-class shared_state
-{
-    enum : uint8_t
-    {
-        empty    = 0,
-        engaged  = 1,
-        waiting  = 2,
-        sent     = 3,
-        detached = 4
+        // upper bound of the bucket holding the given quantile
+        std::chrono::nanoseconds
+        quantile(double q) const noexcept
+        {
+            auto target = static_cast<std::uint64_t>(q * count());
+            auto n      = std::uint64_t{ 0 };
+            for (std::size_t i = 0; i < buckets.size(); i++)
+                if ((n += buckets[i]) > target)
+                    return std::chrono::nanoseconds{ (std::int64_t{ 1 } << i) - 1 };
+            return std::chrono::nanoseconds::max();
+        }
     };
 
-    std::atomic<uint8_t> state_{ empty };
-    [[no_unique_address]] storage<T> storage_;
-    void (*deleter_)(shared_state*){ nullptr };
-    wait_op* wait_op_{ nullptr };
-
-  public:
-    shared_state(void (*deleter)(shared_state*)) noexcept
-        : deleter_{ deleter }
+    struct stats
     {
-    }
-
-    shared_state(const shared_state&) = delete;
-    shared_state(shared_state&&)      = delete;
+        histogram send_to_wake;
+        histogram post_to_run;
+        std::array<std::uint64_t, 8> events{};
+        // completions by errc, success at index zero
+        std::array<std::uint64_t, 8> completions{};
+    };
 
-    template<typename... Args>
-    void
-    send(Args&&... args)
+    static void
+    record(const trace_record& r) noexcept
     {
-        storage_.construct(std::forward<Args>(args)...);
+        auto& l = local();
+        bump(l.events[static_cast<std::size_t>(r.event)]);
 
-        // possible vals: empty, waiting, detached(receiver)
-        auto prev = state_.fetch_add(1, std::memory_order_release);
+        if (r.event != trace_event::invoke)
+            return;
 
-        if (prev == detached)
-        {
-            storage_.destroy();
-            return deleter_(this);
-        }
+        auto code = std::size_t{ 0 };
+        if (r.ec && r.ec.category() == oneshot_category())
+            code = std::min<std::size_t>(r.ec.value(), l.completions.size() - 1);
+        bump(l.completions[code]);
 
-        if (prev == waiting)
-        {
-            std::atomic_thread_fence(std::memory_order_acquire);
-            wait_op_->complete({});
-        }
+        bump(l.send_to_wake[bucket(r.time - r.signalled)]);
+        bump(l.post_to_run[bucket(r.time - r.posted)]);
     }
 
-    void
-    sender_detached() noexcept
+    // sums the counters of all threads, including those that have exited
+    static stats
+    collect()
     {
-        // possible vals: empty, waiting, detached(receiver)
-        auto prev = state_.exchange(detached, std::memory_order_relaxed);
+        auto& r    = registry();
+        auto lock  = std::lock_guard{ r.mutex };
+        auto total = r.retired;
+        for (auto* l = r.threads; l; l = l->next)
+            l->add_to(total);
+        return total;
+    }
 
-        if (prev == detached)
-            return deleter_(this);
+  private:
+    struct local_stats
+    {
+        std::array<counter, 64> send_to_wake{};
+        std::array<counter, 64> post_to_run{};
+        std::array<counter, 8> events{};
+        std::array<counter, 8> completions{};
+        local_stats* next{ nullptr };
 
-        if (prev == waiting)
+        local_stats()
         {
-            std::atomic_thread_fence(std::memory_order_acquire);
-            wait_op_->complete(errc::broken_sender);
+            auto& r   = registry();
+            auto lock = std::lock_guard{ r.mutex };
+            next      = std::exchange(r.threads, this);
         }
-    }
 
-    template<typename CompletionToken>
-    auto
-    async_wait(CompletionToken&& token)
-    {
-        return net::async_initiate<decltype(token), void(error_code)>(
-            [this](auto handler)
+        ~local_stats()
+        {
+            auto& r   = registry();
+            auto lock = std::lock_guard{ r.mutex };
+            add_to(r.retired);
+            for (auto** p = &r.threads; *p; p = &(*p)->next)
             {
-                auto exec = net::get_associated_executor(handler);
-
-                using handler_type = std::decay_t<decltype(handler)>;
-                using model_type  = wait_op_model<decltype(exec), handler_type>;
-                model_type* model = model_type ::construct(
-                    std::move(exec), std::forward<decltype(handler)>(handler));
-                auto c_slot = model->get_cancellation_slot();
-                if (c_slot.is_connected())
+                if (*p == this)
                 {
-                    c_slot.assign(
-                        [this](net::cancellation_type type)
-                        {
-                            if (type != net::cancellation_type::none)
-                            {
-                                // possible vals: waiting, sent,
-                                // detached(sender)
-                                auto prev = state_.exchange(
-                                    empty, std::memory_order_relaxed);
-
-                                if (prev == waiting)
-                                {
-                                    wait_op_->complete(errc::cancelled);
-                                    wait_op_ = nullptr;
-                                }
-                                else // prev has been sent or detached(sender)
-                                {
-                                    state_.store(
-                                        prev, std::memory_order_relaxed);
-                                }
-                            }
-                        });
+                    *p = next;
+                    break;
                 }
+            }
+        }
 
-                if (wait_op_)
-                    return model->complete(errc::duplicate_wait_on_receiver);
-
-                wait_op_ = model;
-
-                // possible vals: empty, engaged, detached(sender)
-                auto prev = state_.exchange(waiting, std::memory_order_release);
-
-                if (prev == detached)
-                {
-                    state_.store(prev, std::memory_order_relaxed);
-                    model->complete(errc::broken_sender);
-                }
-                else if (prev == engaged)
-                {
-                    state_.store(prev, std::memory_order_relaxed);
-                    model->complete({});
-                }
-            },
-            token);
-    }
+        void
+        add_to(stats& s) const noexcept
+        {
+            auto add = [](auto& to, const auto& from)
+            {
+                for (std::size_t i = 0; i < to.size(); i++)
+                    to[i] += from[i].load(std::memory_order_relaxed);
+            };
+            add(s.send_to_wake.buckets, send_to_wake);
+            add(s.post_to_run.buckets, post_to_run);
+            add(s.events, events);
+            add(s.completions, completions);
+        }
+    };
 
-    void
-    receiver_detached() noexcept
+    struct registry_type
     {
-        // possible vals: empty, engaged, sent, detached(sender)
-        auto prev = state_.exchange(detached, std::memory_order_relaxed);
-
-        if (prev == detached)
-            return deleter_(this);
+        std::mutex mutex;
+        local_stats* threads{ nullptr };
+        stats retired;
+    };
 
-        if (prev == engaged || prev == sent)
-        {
-            std::atomic_thread_fence(std::memory_order_acquire);
-            storage_.destroy();
-            return deleter_(this);
-        }
+    static registry_type&
+    registry() noexcept
+    {
+        static registry_type r;
+        return r;
     }
 
-    bool
-    is_ready() const noexcept
+    static local_stats&
+    local() noexcept
     {
-        auto state = state_.load(std::memory_order_relaxed);
-        return state == sent || state == engaged;
+        thread_local local_stats l;
+        return l;
     }
 
-    T*
-    get_stored_object() noexcept
+    static std::size_t
+    bucket(trace_clock::duration d) noexcept
     {
-        auto state = state_.load(std::memory_order_acquire);
-
-        if (state == sent || state == engaged)
-            return storage_.object();
-
-        return nullptr;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        return std::bit_width(static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 0)));
     }
 };
 
-template<typename T>
-struct async_extract_signature
+namespace detail
 {
-    using type = void(error_code, T);
-};
-
-template<>
-struct async_extract_signature<void>
+struct no_instrumentation
 {
-    using type = void(error_code);
+    static void
+    record(const trace_record&) noexcept
+    {
+    }
 };
 
-template<typename T>
-using async_extract_signature_t = typename async_extract_signature<T>::type;
+#ifdef ONESHOT_INSTRUMENTATION
+using instrumentation = ONESHOT_INSTRUMENTATION;
+#else
+using instrumentation = no_instrumentation;
+#endif
 
-template<typename T, class X>
-class shs_handle
-{
-    shared_state<T>* shared_state_{ nullptr };
+inline constexpr bool instrumented =
+    !std::is_same_v<instrumentation, no_instrumentation>;
 
-  public:
-    shs_handle() noexcept = default;
-    shs_handle(shared_state<T>* shared_state) noexcept
-        : shared_state_{ shared_state }
+// compiles to nothing without instrumentation, the instrumentation type only
+// has to be complete where the header's templates are instantiated
+template<typename Instrumentation = instrumentation>
+trace_clock::time_point
+trace(
+    trace_event event,
+    const void* id,
+    error_code ec                     = {},
+    trace_clock::time_point signalled = {},
+    trace_clock::time_point posted    = {}) noexcept
+{
+    if constexpr (instrumented)
+    {
+        auto now = trace_clock::now();
+        Instrumentation::record({ event, id, now, ec, signalled, posted });
+        return now;
+    }
+    else
     {
+        return {};
     }
+}
 
-    shs_handle(shs_handle&& other) noexcept
+// timestamps carried by a wait operation, empty without instrumentation
+template<bool Enabled = instrumented>
+struct trace_data
+{
+    trace_clock::time_point signalled;
+    trace_clock::time_point posted;
+
+    void
+    signal(trace_clock::time_point t) noexcept
     {
-        std::swap(shared_state_, other.shared_state_);
+        signalled = t;
     }
 
-    shs_handle&
-    operator=(shs_handle&& other) noexcept
+    void
+    post(const void* id) noexcept
     {
-        std::swap(shared_state_, other.shared_state_);
-        return *this;
+        posted = trace(trace_event::post, id);
+        if (signalled == trace_clock::time_point{})
+            signalled = posted;
     }
 
-    operator bool() const noexcept
+    void
+    invoke(const void* id, error_code ec) const noexcept
     {
-        return shared_state_ != nullptr;
+        trace(trace_event::invoke, id, ec, signalled, posted);
     }
+};
 
-    shared_state<T>*
-    operator->() const noexcept
+template<>
+struct trace_data<false>
+{
+    void
+    signal(trace_clock::time_point) noexcept
     {
-        return shared_state_;
     }
 
-    shared_state<T>*
-    release() noexcept
+    void
+    post(const void*) noexcept
     {
-        return std::exchange(shared_state_, nullptr);
     }
 
-    ~shs_handle()
+    void
+    invoke(const void*, error_code) const noexcept
     {
-        if (shared_state_)
-            X::detach(shared_state_);
     }
 };
+} // namespace detail
 
-template<typename T>
-struct sender_shs_handle : shs_handle<T, sender_shs_handle<T>>
+// Default policy, the sender and receiver can reside on different threads.
+struct thread_safe
 {
+    template<typename T>
+    using atomic = std::atomic<T>;
+
     static void
-    detach(shared_state<T>* p) noexcept
+    fence(std::memory_order order) noexcept
     {
-        p->sender_detached();
+        std::atomic_thread_fence(order);
     }
 };
 
-template<typename T>
-struct receiver_shs_handle : shs_handle<T, receiver_shs_handle<T>>
+// The sender and receiver never leave a single thread (or strand), the
+// shared state uses plain loads and stores and skips the fences.
+struct single_threaded
 {
+    template<typename T>
+    using atomic = detail::unsynchronized_atomic<T>;
+
     static void
-    detach(shared_state<T>* p) noexcept
+    fence(std::memory_order) noexcept
     {
-        p->receiver_detached();
     }
 };
 
+namespace detail
+{
+struct wait_op;
 } // namespace detail
 
+template<typename T, typename Policy>
+class sender;
+
+// Collects the completions of the sends made through it and posts them once
+// per executor on flush(), so a burst of sends to receivers on the same
+// io_context costs a single queue push there. Completions are always posted,
+// whatever their completion mode.
+class send_batch
+{
+    struct pending
+    {
+        detail::wait_op* op;
+        void (*invoke)(detail::wait_op*, error_code);
+        error_code ec;
+    };
+
+    // Completes its operations when invoked. Those it still holds when it is
+    // destroyed, because posting it failed, the target context shut down
+    // before running it or a handler threw, are destroyed through their
+    // shutdown() instead of leaking.
+    class pending_ops
+    {
+        std::vector<pending> ops_;
+        std::size_t next_{ 0 };
+
+      public:
+        pending_ops() = default;
+
+        pending_ops(pending_ops&& other) noexcept
+            : ops_{ std::move(other.ops_) }
+            , next_{ std::exchange(other.next_, 0) }
+        {
+            other.ops_.clear();
+        }
+
+        pending_ops&
+        operator=(pending_ops&&) = delete;
+
+        ~pending_ops();
+
+        void
+        push_back(pending p)
+        {
+            ops_.push_back(p);
+        }
+
+        void
+        operator()()
+        {
+            while (next_ < ops_.size())
+            {
+                auto& p = ops_[next_++];
+                p.invoke(p.op, p.ec);
+            }
+        }
+    };
+
+    struct group
+    {
+        const void* type;
+        pending_ops ops;
+
+        explicit group(const void* type) noexcept
+            : type{ type }
+        {
+        }
+
+        virtual void
+        post() = 0;
+        virtual ~group() = default;
+    };
+
+    template<typename Executor>
+    struct executor_group final : group
+    {
+        static constexpr char tag{};
+
+        Executor exec;
+
+        explicit executor_group(Executor e)
+            : group{ &tag }
+            , exec(std::move(e))
+        {
+        }
+
+        void
+        post() override
+        {
+            net::post(exec, std::move(ops));
+        }
+    };
+
+    std::vector<std::unique_ptr<group>> groups_;
+
+  public:
+    send_batch() = default;
+
+    send_batch(const send_batch&) = delete;
+    send_batch&
+    operator=(const send_batch&) = delete;
+
+    // the completions are still posted, unless posting them fails
+    ~send_batch()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    template<typename T, typename Policy, typename... Args>
+    void
+    send(sender<T, Policy>& s, Args&&... args)
+    {
+        if (!s.shs_handle_)
+            throw error{ errc::no_state };
+
+        s.shs_handle_->send_batched(*this, std::forward<Args>(args)...);
+        s.shs_handle_.release();
+    }
+
+    // posts the collected completions, one function per executor. If posting
+    // throws, the completions that weren't posted are destroyed.
+    void
+    flush()
+    {
+        auto groups = std::move(groups_);
+        for (auto& g : groups)
+            g->post();
+    }
+
+    // called by a wait operation completed through the batch
+    template<typename Executor>
+    void
+    add(const Executor& exec,
+        detail::wait_op* op,
+        void (*invoke)(detail::wait_op*, error_code),
+        error_code ec)
+    {
+        for (auto& g : groups_)
+        {
+            if (g->type == &executor_group<Executor>::tag &&
+                static_cast<executor_group<Executor>&>(*g).exec == exec)
+                return g->ops.push_back({ op, invoke, ec });
+        }
+
+        auto g = std::make_unique<executor_group<Executor>>(exec);
+        g->ops.push_back({ op, invoke, ec });
+        groups_.push_back(std::move(g));
+    }
+};
+
+namespace detail
+{
+// Storage next to a shared state that a wait operation is constructed in,
+// the operation hands it back through release() once it is destroyed.
+struct wait_op_buffer
+{
+    void (*release)(wait_op_buffer*) noexcept;
+};
+
+// The block holding the storage outlives its shared state while an operation
+// is still constructed in it, the last of the two to go frees the block.
+template<typename Policy>
+class basic_wait_op_buffer : public wait_op_buffer
+{
+    enum : uint8_t
+    {
+        idle     = 0,
+        busy     = 1,
+        orphaned = 2
+    };
+
+    typename Policy::template atomic<uint8_t> state_{ idle };
+    std::uint32_t size_;
+    unsigned char* data_;
+    void (*deallocate_)(basic_wait_op_buffer*) noexcept;
+
+  public:
+    basic_wait_op_buffer(
+        unsigned char* data,
+        std::size_t size,
+        void (*deallocate)(basic_wait_op_buffer*) noexcept) noexcept
+        : wait_op_buffer{ [](wait_op_buffer* self) noexcept
+                          {
+                              auto* p =
+                                  static_cast<basic_wait_op_buffer*>(self);
+                              auto prev = p->state_.exchange(
+                                  idle, std::memory_order_acq_rel);
+                              if (prev == orphaned)
+                                  p->deallocate_(p);
+                          } }
+        , size_{ static_cast<std::uint32_t>(size) }
+        , data_{ data }
+        , deallocate_{ deallocate }
+    {
+    }
+
+    // only called by the receiver side, while the block can't be orphaned
+    void*
+    try_acquire(std::size_t size, std::size_t align) noexcept
+    {
+        if (size > size_ || align > alignof(std::max_align_t))
+            return nullptr;
+
+        if (state_.load(std::memory_order_acquire) != idle)
+            return nullptr;
+
+        state_.store(busy, std::memory_order_relaxed);
+        return data_;
+    }
+
+    // for storage shared by the receivers of several states
+    void*
+    try_acquire_shared(std::size_t size, std::size_t align) noexcept
+    {
+        if (size > size_ || align > alignof(std::max_align_t))
+            return nullptr;
+
+        auto expected = uint8_t{ idle };
+        if (!state_.compare_exchange_strong(
+                expected,
+                busy,
+                std::memory_order_acquire,
+                std::memory_order_relaxed))
+            return nullptr;
+
+        return data_;
+    }
+
+    // returns false if an operation still lives in the storage, that
+    // operation frees the block on release
+    bool
+    orphan() noexcept
+    {
+        return state_.exchange(orphaned, std::memory_order_acq_rel) != busy;
+    }
+};
+
+template<typename Policy, std::size_t Size>
+struct wait_op_storage : basic_wait_op_buffer<Policy>
+{
+    alignas(std::max_align_t) unsigned char data_[Size];
+
+    explicit wait_op_storage(
+        void (*deallocate)(basic_wait_op_buffer<Policy>*) noexcept) noexcept
+        : basic_wait_op_buffer<Policy>{ data_, Size, deallocate }
+    {
+    }
+};
+
+template<typename Policy>
+struct wait_op_storage<Policy, 0>
+{
+    explicit wait_op_storage(
+        void (*)(basic_wait_op_buffer<Policy>*) noexcept) noexcept
+    {
+    }
+};
+
+enum class block_op
+{
+    deallocate,
+    wait_op_buffer,
+    shared_wait_op_buffer,
+    memory_resource
+};
+
+template<typename Allocator>
+struct is_polymorphic_allocator : std::false_type
+{
+};
+
+template<typename T>
+struct is_polymorphic_allocator<std::pmr::polymorphic_allocator<T>>
+    : std::true_type
+{
+};
+
+// The memory resource behind a polymorphic allocator, wait operations that
+// don't fit the storage next to a shared state are allocated from it as well.
+template<typename Allocator>
+std::pmr::memory_resource*
+memory_resource_of(const Allocator& alloc) noexcept
+{
+    if constexpr (is_polymorphic_allocator<Allocator>::value)
+        return alloc.resource();
+    else
+        return nullptr;
+}
+
+// A wait operation allocated from a memory resource, this header sits in
+// front of it and hands the memory back on release().
+struct resource_wait_op_buffer : wait_op_buffer
+{
+    std::pmr::memory_resource* resource_;
+    std::size_t size_;
+    std::size_t align_;
+
+    static constexpr std::size_t
+    offset(std::size_t align) noexcept
+    {
+        auto a = std::max(align, alignof(resource_wait_op_buffer));
+        return (sizeof(resource_wait_op_buffer) + a - 1) / a * a;
+    }
+
+    // returns the memory for the operation, `buffer` is set to its header
+    static void*
+    allocate(
+        std::pmr::memory_resource* resource,
+        std::size_t size,
+        std::size_t align,
+        wait_op_buffer*& buffer)
+    {
+        auto a    = std::max(align, alignof(resource_wait_op_buffer));
+        auto n    = offset(align) + size;
+        auto* mem = resource->allocate(n, a);
+        buffer    = new (mem) resource_wait_op_buffer{
+            { [](wait_op_buffer* self) noexcept
+              {
+                  auto* p = static_cast<resource_wait_op_buffer*>(self);
+                  p->resource_->deallocate(p, p->size_, p->align_);
+              } },
+            resource,
+            n,
+            a
+        };
+        return static_cast<unsigned char*>(mem) + offset(align);
+    }
+};
+
+// A type erased wait operation. Instead of a vtable the operation holds a
+// single function, which is passed the action to perform (as Asio's own
+// scheduler operations do). Derived operations provide the member functions
+// below and pass `&wait_op::func<Derived>` on construction.
+struct wait_op
+{
+    enum class action : uint8_t
+    {
+        shutdown,
+        complete,
+        complete_deferred,
+        complete_immediately,
+        complete_batched
+    };
+
+    using func_type = void (*)(wait_op*, action, error_code, send_batch*);
+
+    explicit wait_op(func_type func) noexcept
+        : func_{ func }
+    {
+    }
+
+    void
+    shutdown() noexcept
+    {
+        func_(this, action::shutdown, {}, nullptr);
+    }
+
+    // completion by the sender side, honours the completion mode
+    void
+    complete(error_code ec)
+    {
+        func_(this, action::complete, ec, nullptr);
+    }
+
+    // completion from a cancellation handler, always deferred
+    void
+    complete_deferred(error_code ec)
+    {
+        func_(this, action::complete_deferred, ec, nullptr);
+    }
+
+    // completion from within the initiating function
+    void
+    complete_immediately(error_code ec)
+    {
+        func_(this, action::complete_immediately, ec, nullptr);
+    }
+
+    // completion by the sender side on behalf of a batch, operations without
+    // a complete_batched() of their own are completed as by complete()
+    void
+    complete_batched(error_code ec, send_batch& batch)
+    {
+        func_(this, action::complete_batched, ec, &batch);
+    }
+
+    [[no_unique_address]] trace_data<> trace_;
+
+  protected:
+    ~wait_op() = default;
+
+    template<typename Op>
+    static void
+    func(wait_op* base, action a, error_code ec, send_batch* batch)
+    {
+        auto* op = static_cast<Op*>(base);
+        switch (a)
+        {
+            case action::shutdown:
+                return op->shutdown();
+            case action::complete:
+                return op->complete(ec);
+            case action::complete_deferred:
+                return op->complete_deferred(ec);
+            case action::complete_immediately:
+                return op->complete_immediately(ec);
+            case action::complete_batched:
+                if constexpr (std::is_same_v<
+                                  decltype(&Op::complete_batched),
+                                  decltype(&wait_op::complete_batched)>)
+                    return op->complete(ec);
+                else
+                    return op->complete_batched(ec, *batch);
+        }
+    }
+
+  private:
+    func_type func_;
+};
+
+// Completes a wait with the error code only.
+struct wait_result
+{
+    template<typename Handler>
+    void
+    operator()(Handler&& handler, error_code ec) &&
+    {
+        std::move(handler)(ec);
+    }
+};
+
+class deadline_queue;
+
+// A wait's place in the deadline_queue of its execution context.
+struct deadline_entry
+{
+    static constexpr auto npos = ~std::size_t{ 0 };
+
+    std::chrono::steady_clock::time_point deadline;
+    deadline_queue* queue{ nullptr };
+    std::size_t index{ npos };
+    wait_op* op{ nullptr };
+    void* state{ nullptr };
+    // withdraws the wait from its shared state, false if it is being completed
+    bool (*withdraw)(deadline_entry&) noexcept { nullptr };
+};
+
+// The deadlines of the timed waits started on an execution context, kept in
+// a binary heap. They share a single timer armed for the earliest one, which
+// is cancelled once the heap runs empty so that run() can return.
+class deadline_queue : public net::execution_context::service
+{
+    std::mutex mutex_;
+    std::vector<deadline_entry*> heap_;
+    std::optional<net::steady_timer> timer_;
+    std::uint64_t generation_{ 0 };
+
+    // the timed waits still pending are withdrawn from their shared states
+    // and destroyed without their handlers being invoked
+    void
+    shutdown() override
+    {
+        auto pending = std::vector<deadline_entry*>{};
+        {
+            auto lock = std::lock_guard{ mutex_ };
+            pending.swap(heap_);
+            for (auto* e : pending)
+                e->index = deadline_entry::npos;
+            timer_.reset();
+        }
+
+        // destroying the operations removes them from the emptied queue
+        for (auto* e : pending)
+        {
+            if (e->withdraw(*e))
+                e->op->shutdown();
+        }
+    }
+
+    bool
+    before(std::size_t a, std::size_t b) const noexcept
+    {
+        return heap_[a]->deadline < heap_[b]->deadline;
+    }
+
+    void
+    swap(std::size_t a, std::size_t b) noexcept
+    {
+        std::swap(heap_[a], heap_[b]);
+        heap_[a]->index = a;
+        heap_[b]->index = b;
+    }
+
+    void
+    sift_up(std::size_t i) noexcept
+    {
+        for (; i > 0 && before(i, (i - 1) / 2); i = (i - 1) / 2)
+            swap(i, (i - 1) / 2);
+    }
+
+    void
+    sift_down(std::size_t i) noexcept
+    {
+        for (;;)
+        {
+            auto c = 2 * i + 1;
+            if (c >= heap_.size())
+                return;
+            if (c + 1 < heap_.size() && before(c + 1, c))
+                c++;
+            if (!before(c, i))
+                return;
+            swap(i, c);
+            i = c;
+        }
+    }
+
+    void
+    erase(deadline_entry& e) noexcept
+    {
+        auto i = e.index;
+        swap(i, heap_.size() - 1);
+        heap_.pop_back();
+        e.index = deadline_entry::npos;
+
+        if (i < heap_.size())
+        {
+            auto* moved = heap_[i];
+            sift_up(i);
+            sift_down(moved->index);
+        }
+    }
+
+    void
+    arm()
+    {
+        timer_->expires_at(heap_.front()->deadline);
+        timer_->async_wait([this, g = ++generation_](auto)
+                           { expire(g); });
+    }
+
+    void
+    expire(std::uint64_t generation)
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        if (generation != generation_)
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        while (!heap_.empty() && heap_.front()->deadline <= now)
+        {
+            auto& e = *heap_.front();
+            erase(e);
+            if (e.withdraw(e))
+                e.op->complete_deferred(errc::timeout);
+        }
+
+        if (!heap_.empty())
+            arm();
+    }
+
+  public:
+    static inline net::execution_context::id id;
+
+    explicit deadline_queue(net::execution_context& ctx)
+        : net::execution_context::service{ ctx }
+    {
+    }
+
+    template<typename Executor>
+    static deadline_queue&
+    use(const Executor& exec)
+    {
+        auto& q = net::use_service<deadline_queue>(
+            net::query(exec, net::execution::context));
+
+        auto lock = std::lock_guard{ q.mutex_ };
+        if (!q.timer_)
+            q.timer_.emplace(exec);
+        return q;
+    }
+
+    // queues `e` and starts the wait, the timer can't fire in between
+    template<typename Start>
+    bool
+    start(deadline_entry& e, Start start_wait)
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        e.index   = heap_.size();
+        heap_.push_back(&e);
+        sift_up(e.index);
+
+        if (!start_wait())
+        {
+            erase(e);
+            return false;
+        }
+
+        if (e.index == 0)
+            arm();
+        return true;
+    }
+
+    void
+    remove(deadline_entry& e) noexcept
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        if (e.index == deadline_entry::npos)
+            return;
+
+        erase(e);
+        if (heap_.empty() && timer_)
+        {
+            ++generation_;
+            timer_->cancel();
+        }
+    }
+};
+
+// Completes a wait like `Result`, unless its deadline passes first.
+template<typename Result>
+struct timed_result
+{
+    Result result;
+    deadline_entry entry;
+
+    void
+    detach() noexcept
+    {
+        if (entry.queue)
+            entry.queue->remove(entry);
+    }
+
+    template<typename Handler>
+    void
+    operator()(Handler&& handler, error_code ec) &&
+    {
+        std::move(result)(std::forward<Handler>(handler), ec);
+    }
+};
+
+template<typename Result>
+struct is_timed_result : std::false_type
+{
+};
+
+template<typename Result>
+struct is_timed_result<timed_result<Result>> : std::true_type
+{
+};
+
+// Stands in for the cancellation slot of handlers that have none, so the
+// cancellation handling of their waits is known to be dead at compile time.
+struct null_cancellation_slot
+{
+    static constexpr bool
+    is_connected() noexcept
+    {
+        return false;
+    }
+
+    template<typename F>
+    void
+    assign(F&&) noexcept
+    {
+    }
+
+    void
+    clear() noexcept
+    {
+    }
+};
+
+template<class Executor, class Handler, class Result = wait_result>
+class wait_op_model final : public wait_op
+{
+    // the mode sits in the tail padding of the work guard
+    [[no_unique_address]] net::executor_work_guard<Executor> work_guard_;
+    completion_mode mode_;
+    wait_op_buffer* buffer_{ nullptr };
+    Handler handler_;
+    [[no_unique_address]] Result result_;
+
+    auto
+    completion(error_code ec)
+    {
+        return [this, ec]()
+        {
+            get_cancellation_slot().clear();
+            if constexpr (is_timed_result<Result>::value)
+                result_.detach();
+            trace_.invoke(this, ec);
+            auto g = std::move(work_guard_);
+            auto h = std::move(handler_);
+            auto r = std::move(result_);
+            destroy(this, net::get_associated_allocator(h));
+            std::move(r)(std::move(h), ec);
+        };
+    }
+
+  public:
+    wait_op_model(
+        Executor e,
+        Handler handler,
+        completion_mode mode,
+        Result result)
+        : wait_op{ &wait_op::func<wait_op_model> }
+        , work_guard_(std::move(e))
+        , mode_(mode)
+        , handler_(std::move(handler))
+        , result_(std::move(result))
+    {
+    }
+
+    // handlers without a slot of their own get a null_cancellation_slot
+    [[nodiscard]] auto
+    get_cancellation_slot() const noexcept
+    {
+        return net::associated_cancellation_slot<
+            Handler,
+            null_cancellation_slot>::get(handler_);
+    }
+
+    // constructs in `mem` if provided, which belongs to `buffer`
+    static wait_op_model*
+    construct(
+        Executor e,
+        Handler handler,
+        completion_mode mode,
+        Result result,
+        void* mem              = nullptr,
+        wait_op_buffer* buffer = nullptr)
+    {
+        if (mem)
+        {
+            try
+            {
+                auto* p = new (mem) wait_op_model(
+                    std::move(e), std::move(handler), mode, std::move(result));
+                p->buffer_ = buffer;
+                return p;
+            }
+            catch (...)
+            {
+                buffer->release(buffer);
+                throw;
+            }
+        }
+
+        auto halloc = net::get_associated_allocator(handler);
+        auto alloc  = typename std::allocator_traits<
+            decltype(halloc)>::template rebind_alloc<wait_op_model>(halloc);
+        using traits = std::allocator_traits<decltype(alloc)>;
+        auto pmem    = traits::allocate(alloc, 1);
+
+        try
+        {
+            return new (pmem) wait_op_model(
+                std::move(e), std::move(handler), mode, std::move(result));
+        }
+        catch (...)
+        {
+            traits::deallocate(alloc, pmem, 1);
+            throw;
+        }
+    }
+
+    static void
+    destroy(wait_op_model* self, net::associated_allocator_t<Handler> halloc)
+    {
+        if (auto* buffer = self->buffer_)
+        {
+            self->~wait_op_model();
+            return buffer->release(buffer);
+        }
+
+        auto alloc = typename std::allocator_traits<
+            decltype(halloc)>::template rebind_alloc<wait_op_model>(halloc);
+        self->~wait_op_model();
+        auto traits = std::allocator_traits<decltype(alloc)>();
+        traits.deallocate(alloc, self, 1);
+    }
+
+    void
+    complete(error_code ec)
+    {
+        trace_.post(this);
+        if (mode_ == completion_mode::dispatch)
+            net::dispatch(work_guard_.get_executor(), completion(ec));
+        else
+            net::post(work_guard_.get_executor(), completion(ec));
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        trace_.post(this);
+        if constexpr (is_timed_result<Result>::value)
+        {
+            // the deadline queue completes expired waits under its lock
+            net::post(work_guard_.get_executor(), completion(ec));
+        }
+        else
+        {
+            // the op is released before the handler runs, so a wait started
+            // in between takes over its storage
+            auto slot   = get_cancellation_slot();
+            auto halloc = net::get_associated_allocator(handler_);
+            auto exec   = work_guard_.get_executor();
+            net::post(
+                exec,
+                [g  = std::move(work_guard_),
+                 h  = std::move(handler_),
+                 r  = std::move(result_),
+                 t  = trace_,
+                 id = static_cast<const void*>(this),
+                 ec]() mutable
+                {
+                    t.invoke(id, ec);
+                    std::move(r)(std::move(h), ec);
+                });
+            slot.clear();
+            destroy(this, halloc);
+        }
+    }
+
+    void
+    complete_batched(error_code ec, send_batch& batch)
+    {
+        try
+        {
+            batch.add(work_guard_.get_executor(), this, &invoke, ec);
+        }
+        catch (...)
+        {
+            return complete(ec);
+        }
+        trace_.post(this);
+    }
+
+    static void
+    invoke(wait_op* self, error_code ec)
+    {
+        static_cast<wait_op_model*>(self)->completion(ec)();
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        trace_.post(this);
+#ifdef ONESHOT_HAS_IMMEDIATE_EXECUTOR
+        auto exec = net::get_associated_immediate_executor(
+            handler_, work_guard_.get_executor());
+        net::dispatch(exec, completion(ec));
+#else
+        net::post(work_guard_.get_executor(), completion(ec));
+#endif
+    }
+
+    void
+    shutdown() noexcept
+    {
+        get_cancellation_slot().clear();
+        if constexpr (is_timed_result<Result>::value)
+            result_.detach();
+        destroy(this, net::get_associated_allocator(this->handler_));
+    }
+
+    Result&
+    result() noexcept
+    {
+        return result_;
+    }
+};
+
+// Spins briefly before a blocking wait parks the thread, a value that is
+// about to be sent doesn't cost a kernel round trip.
+template<typename Predicate>
+bool
+spin_until(Predicate pred) noexcept
+{
+    for (auto i = 0; i < 64; i++)
+    {
+        if (pred())
+            return true;
+        if (i >= 16)
+            std::this_thread::yield();
+    }
+    return false;
+}
+
+#ifdef __cpp_lib_atomic_wait
+// A wait parked on the stack of a thread without an executor. The flag goes
+// through notifying so that the waiter doesn't return while notify_one() is
+// still touching it.
+class blocking_wait_op final : public wait_op
+{
+    enum : uint8_t
+    {
+        pending   = 0,
+        notifying = 1,
+        done      = 2
+    };
+
+    std::atomic<uint8_t> flag_{ pending };
+    error_code ec_;
+
+  public:
+    blocking_wait_op() noexcept
+        : wait_op{ &wait_op::func<blocking_wait_op> }
+    {
+    }
+
+    void
+    shutdown() noexcept
+    {
+    }
+
+    void
+    complete(error_code ec)
+    {
+        ec_ = ec;
+        flag_.store(notifying, std::memory_order_release);
+        flag_.notify_one();
+        flag_.store(done, std::memory_order_release);
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        complete(ec);
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        complete(ec);
+    }
+
+    error_code
+    wait() noexcept
+    {
+        if (!spin_until(
+                [&] { return flag_.load(std::memory_order_acquire) != pending; }))
+            flag_.wait(pending, std::memory_order_acquire);
+
+        while (flag_.load(std::memory_order_acquire) != done)
+            std::this_thread::yield();
+
+        return ec_;
+    }
+};
+#endif
+
+// A wait parked on the stack of a thread without an executor, with a deadline.
+class timed_wait_op final : public wait_op
+{
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> done_{ false };
+    error_code ec_;
+
+  public:
+    timed_wait_op() noexcept
+        : wait_op{ &wait_op::func<timed_wait_op> }
+    {
+    }
+
+    void
+    shutdown() noexcept
+    {
+    }
+
+    void
+    complete(error_code ec)
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        ec_       = ec;
+        done_.store(true, std::memory_order_relaxed);
+        cv_.notify_one();
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        complete(ec);
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        complete(ec);
+    }
+
+    // returns false on timeout
+    template<typename Clock, typename Duration>
+    bool
+    wait_until(
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        error_code& ec)
+    {
+        spin_until([&] { return done_.load(std::memory_order_relaxed); });
+
+        auto lock = std::unique_lock{ mutex_ };
+        if (!cv_.wait_until(
+                lock,
+                deadline,
+                [&] { return done_.load(std::memory_order_relaxed); }))
+            return false;
+
+        ec = ec_;
+        return true;
+    }
+
+    error_code
+    wait()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        cv_.wait(lock, [&] { return done_.load(std::memory_order_relaxed); });
+        return ec_;
+    }
+};
+
+template<typename T>
+struct storage;
+
+template<>
+struct storage<void>
+{
+    void
+    construct() noexcept
+    {
+    }
+
+    template<typename F>
+    void
+    construct_with(F&& f)
+    {
+        std::invoke(std::forward<F>(f));
+    }
+
+    void
+    destroy() noexcept
+    {
+    }
+
+    void*
+    object() noexcept
+    {
+        return nullptr;
+    }
+};
+
+template<typename T>
+struct storage
+{
+    alignas(T) char payload_[sizeof(T)];
+
+    template<typename... Args>
+    void
+    construct(Args&&... args)
+    {
+        new (&payload_) T(std::forward<Args>(args)...);
+    }
+
+    // `f()` returning a prvalue constructs the value in place
+    template<typename F>
+    void
+    construct_with(F&& f)
+    {
+        new (&payload_) T(std::invoke(std::forward<F>(f)));
+    }
+
+    void
+    destroy() noexcept
+    {
+        std::destroy_at(object());
+    }
+
+    T*
+    object() noexcept
+    {
+        return std::launder(reinterpret_cast<T*>(&payload_));
+    }
+};
+
+// Small trivially copyable values are packed into the state word when their
+// type opts in through pack_into_state.
+template<typename T>
+struct is_packed
+    : std::bool_constant<
+          pack_into_state<T>::value && std::is_trivially_copyable_v<T> &&
+          std::is_copy_constructible_v<T> && sizeof(T) < sizeof(std::uint64_t)>
+{
+};
+
+template<>
+struct is_packed<void> : std::false_type
+{
+};
+
+template<typename T, typename Policy = thread_safe>
+class shared_state
+{
+    enum : uint8_t
+    {
+        empty    = 0,
+        engaged  = 1,
+        waiting  = 2,
+        sent     = 3,
+        detached = 4
+    };
+
+    static constexpr bool packed = is_packed<T>::value;
+    using word_type = std::conditional_t<packed, std::uint64_t, uint8_t>;
+
+    // a packed value lives in the bytes of the state word above the tag
+    typename Policy::template atomic<word_type> state_{ empty };
+    [[no_unique_address]] storage<std::conditional_t<packed, void, T>> storage_;
+    void* (*manager_)(shared_state*, block_op) noexcept { nullptr };
+    wait_op* wait_op_{ nullptr };
+
+    static constexpr uint8_t
+    tag(word_type word) noexcept
+    {
+        return static_cast<uint8_t>(word);
+    }
+
+    // byte by byte, so the layout doesn't depend on endianness
+    template<typename U = T>
+    static word_type
+    encode(const U& value) noexcept
+    {
+        auto bytes = std::bit_cast<std::array<unsigned char, sizeof(U)>>(value);
+        auto word  = word_type{ 0 };
+        for (auto i = sizeof(U); i-- > 0;)
+            word = word << 8 | bytes[i];
+        return word << 8;
+    }
+
+    template<typename U = T>
+    static U
+    decode(word_type word) noexcept
+    {
+        auto bytes = std::array<unsigned char, sizeof(U)>{};
+        for (auto& b : bytes)
+            b = static_cast<unsigned char>(word >>= 8);
+        return std::bit_cast<U>(bytes);
+    }
+
+    void
+    release() noexcept
+    {
+        auto* buffer = op_buffer();
+
+        if (!buffer || buffer->orphan())
+            manager_(this, block_op::deallocate);
+    }
+
+    basic_wait_op_buffer<Policy>*
+    op_buffer() noexcept
+    {
+        return static_cast<basic_wait_op_buffer<Policy>*>(
+            manager_(this, block_op::wait_op_buffer));
+    }
+
+    // storage for an operation of `size` bytes, in the buffer next to the
+    // state or else from the state's memory resource if `fallback` is set
+    void*
+    acquire_op_storage(
+        std::size_t size,
+        std::size_t align,
+        bool fallback,
+        wait_op_buffer*& buffer)
+    {
+        // a duplicate wait must not reuse the storage of the first
+        auto* own = wait_op_ ? nullptr : op_buffer();
+        if (void* mem = own ? own->try_acquire(size, align) : nullptr)
+        {
+            buffer = own;
+            return mem;
+        }
+
+        // the states of an arena share a single buffer between them
+        auto* shared = own || wait_op_
+            ? nullptr
+            : static_cast<basic_wait_op_buffer<Policy>*>(
+                  manager_(this, block_op::shared_wait_op_buffer));
+        if (void* mem =
+                shared ? shared->try_acquire_shared(size, align) : nullptr)
+        {
+            buffer = shared;
+            return mem;
+        }
+
+        buffer = nullptr;
+        if (!fallback)
+            return nullptr;
+
+        auto* resource = static_cast<std::pmr::memory_resource*>(
+            manager_(this, block_op::memory_resource));
+        if (!resource)
+            return nullptr;
+
+        return resource_wait_op_buffer::allocate(resource, size, align, buffer);
+    }
+
+  public:
+    using policy_type = Policy;
+
+    shared_state(void* (*manager)(shared_state*, block_op) noexcept) noexcept
+        : manager_{ manager }
+    {
+    }
+
+    shared_state(const shared_state&) = delete;
+    shared_state(shared_state&&)      = delete;
+
+    template<typename... Args>
+    void
+    send(Args&&... args)
+    {
+        emplace(nullptr, [&] { return construct(std::forward<Args>(args)...); });
+    }
+
+    // as send(), a pending wait is completed through `batch`
+    template<typename... Args>
+    void
+    send_batched(send_batch& batch, Args&&... args)
+    {
+        emplace(&batch, [&] { return construct(std::forward<Args>(args)...); });
+    }
+
+    // as send(), the value is the result of `f()`
+    template<typename F>
+    void
+    send_with(F&& f)
+    {
+        emplace(
+            nullptr,
+            [&]() -> word_type
+            {
+                if constexpr (packed)
+                    return encode(std::invoke(std::forward<F>(f)));
+                else
+                {
+                    storage_.construct_with(std::forward<F>(f));
+                    return 0;
+                }
+            });
+    }
+
+    // as send(), `f` fills a default constructed value in place
+    template<typename F>
+    void
+    send_filled(F&& f)
+    {
+        emplace(
+            nullptr,
+            [&]() -> word_type
+            {
+                if constexpr (packed)
+                {
+                    auto value = T();
+                    std::invoke(std::forward<F>(f), value);
+                    return encode(value);
+                }
+                else
+                {
+                    storage_.construct();
+                    try
+                    {
+                        std::invoke(std::forward<F>(f), *storage_.object());
+                    }
+                    catch (...)
+                    {
+                        storage_.destroy();
+                        throw;
+                    }
+                    return 0;
+                }
+            });
+    }
+
+  private:
+    // returns the bits of a packed value, others are constructed in storage
+    template<typename... Args>
+    word_type
+    construct(Args&&... args)
+    {
+        if constexpr (packed)
+            return encode(T(std::forward<Args>(args)...));
+        else
+        {
+            storage_.construct(std::forward<Args>(args)...);
+            return 0;
+        }
+    }
+
+    template<typename Build>
+    void
+    emplace(send_batch* batch, Build&& build)
+    {
+        auto t    = trace(trace_event::send, this);
+        auto tags = word_type{ 1 } + build();
+
+        // possible vals: empty, waiting, detached(receiver)
+        auto prev = state_.fetch_add(tags, std::memory_order_release);
+
+        if (tag(prev) == detached)
+        {
+            storage_.destroy();
+            return release();
+        }
+
+        if (tag(prev) == waiting)
+        {
+            Policy::fence(std::memory_order_acquire);
+            wait_op_->trace_.signal(t);
+            if (batch)
+                wait_op_->complete_batched({}, *batch);
+            else
+                wait_op_->complete({});
+        }
+    }
+
+  public:
+
+    void
+    sender_detached() noexcept
+    {
+        // possible vals: empty, waiting, detached(receiver)
+        auto prev = state_.exchange(detached, std::memory_order_relaxed);
+
+        if (tag(prev) == detached)
+            return release();
+
+        auto t = trace(trace_event::broken_sender, this);
+        if (tag(prev) == waiting)
+        {
+            Policy::fence(std::memory_order_acquire);
+            wait_op_->trace_.signal(t);
+            wait_op_->complete(errc::broken_sender);
+        }
+    }
+
+    // `result` turns the wait's error code into the completion of `Signature`
+    template<
+        typename Signature = void(error_code),
+        typename CompletionToken,
+        typename Result = wait_result>
+    auto
+    async_wait(
+        completion_mode mode,
+        CompletionToken&& token,
+        Result result = {})
+    {
+        return net::async_initiate<decltype(token), Signature>(
+            [this, mode](auto handler, Result result)
+            {
+                auto exec = net::get_associated_executor(handler);
+
+                using handler_type = std::decay_t<decltype(handler)>;
+                using model_type =
+                    wait_op_model<decltype(exec), handler_type, Result>;
+
+                if constexpr (is_timed_result<Result>::value)
+                {
+                    result.entry.queue    = &deadline_queue::use(exec);
+                    result.entry.state    = this;
+                    result.entry.withdraw = [](deadline_entry& e) noexcept
+                    {
+                        return static_cast<shared_state*>(e.state)->cancel_wait(
+                            e.op);
+                    };
+                }
+
+                // handlers with an allocator of their own keep using it
+                auto* buffer = static_cast<wait_op_buffer*>(nullptr);
+                void* mem    = acquire_op_storage(
+                    sizeof(model_type),
+                    alignof(model_type),
+                    std::is_same_v<
+                        net::associated_allocator_t<handler_type>,
+                        std::allocator<void>>,
+                    buffer);
+                model_type* model = model_type ::construct(
+                    std::move(exec),
+                    std::forward<decltype(handler)>(handler),
+                    mode,
+                    std::move(result),
+                    mem,
+                    buffer);
+                // A wait has no side effects to undo, so terminal, partial
+                // and total cancellation all withdraw it with a single CAS
+                // from `waiting`; a send or a broken sender that got there
+                // first is never hidden from concurrent readers. The state
+                // can be waited on again right away, and a wait started by
+                // the cancelled handler reuses the in-place storage.
+                auto c_slot = model->get_cancellation_slot();
+                if (c_slot.is_connected())
+                {
+                    c_slot.assign(
+                        [this, model](net::cancellation_type type)
+                        {
+                            if (type != net::cancellation_type::none &&
+                                cancel_wait(model))
+                                model->complete_deferred(errc::cancelled);
+                        });
+                }
+
+                auto ec = error_code{};
+                if constexpr (is_timed_result<Result>::value)
+                {
+                    auto& entry = model->result().entry;
+                    entry.op    = model;
+                    auto started = false;
+                    try
+                    {
+                        started = entry.queue->start(
+                            entry, [&] { return start_wait(model, ec); });
+                    }
+                    catch (...)
+                    {
+                        model->shutdown();
+                        throw;
+                    }
+                    if (!started)
+                        model->complete_immediately(ec);
+                }
+                else if (!start_wait(model, ec))
+                {
+                    model->complete_immediately(ec);
+                }
+            },
+            token,
+            std::move(result));
+    }
+
+    // constructs `Op` in the wait operation storage if it fits and starts it,
+    // `Op` frees itself through the buffer it is given (null if allocated)
+    template<typename Op, typename... Args>
+    void
+    start_op(Args&&... args)
+    {
+        auto* buffer = static_cast<wait_op_buffer*>(nullptr);
+        void* mem    = acquire_op_storage(sizeof(Op), alignof(Op), true, buffer);
+        if (!mem)
+            mem = ::operator new(sizeof(Op), std::align_val_t{ alignof(Op) });
+
+        Op* op;
+        try
+        {
+            op = new (mem) Op(buffer, std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            if (buffer)
+                buffer->release(buffer);
+            else
+                ::operator delete(mem, std::align_val_t{ alignof(Op) });
+            throw;
+        }
+
+        auto ec = error_code{};
+        if (!start_wait(op, ec))
+            op->complete_immediately(ec);
+    }
+
+    // registers `op` to be completed by the sender side, returns false with
+    // the completion in `ec` if the state has been settled already
+    bool
+    start_wait(wait_op* op, error_code& ec) noexcept
+    {
+        if (wait_op_)
+        {
+            ec = errc::duplicate_wait_on_receiver;
+            return false;
+        }
+
+        wait_op_ = op;
+        trace(trace_event::wait, this);
+
+        // possible vals: empty, engaged, detached(sender)
+        auto prev = state_.exchange(waiting, std::memory_order_release);
+
+        if (tag(prev) == detached)
+        {
+            state_.store(prev, std::memory_order_relaxed);
+            ec = errc::broken_sender;
+            return false;
+        }
+
+        if (tag(prev) == engaged)
+        {
+            state_.store(prev, std::memory_order_relaxed);
+            return false;
+        }
+
+        return true;
+    }
+
+    // withdraws `op` if the sender side hasn't taken it yet, the state can be
+    // waited on again afterwards
+    bool
+    cancel_wait(wait_op* op) noexcept
+    {
+        if (wait_op_ != op)
+            return false;
+
+        // No intermediate cancelling state is needed: a send or a broken
+        // sender exchanges `waiting` away before touching the wait, so of the
+        // two racing sides only one sees `waiting`, and this CAS fails if it
+        // is the sender.
+        word_type expected = waiting;
+        if (!state_.compare_exchange_strong(
+                expected,
+                empty,
+                std::memory_order_relaxed,
+                std::memory_order_relaxed))
+            return false;
+
+        wait_op_ = nullptr;
+        trace(trace_event::cancel, this);
+        return true;
+    }
+
+    void
+    receiver_detached() noexcept
+    {
+        trace(trace_event::receiver_detached, this);
+
+        // possible vals: empty, engaged, sent, detached(sender)
+        auto prev = state_.exchange(detached, std::memory_order_relaxed);
+
+        if (tag(prev) == detached)
+            return release();
+
+        if (tag(prev) == engaged || tag(prev) == sent)
+        {
+            Policy::fence(std::memory_order_acquire);
+            storage_.destroy();
+            return release();
+        }
+    }
+
+    // blocks the calling thread until the state is settled
+    error_code
+    wait()
+    {
+        static_assert(
+            std::is_same_v<Policy, thread_safe>,
+            "Blocking waits need a thread-safe state");
+
+#ifdef __cpp_lib_atomic_wait
+        auto op = blocking_wait_op{};
+#else
+        auto op = timed_wait_op{};
+#endif
+        // a settled state returns right away, even after a completed wait
+        auto ec = error_code{};
+        if (poll(ec) || ec == errc::broken_sender)
+            return ec;
+
+        if (start_wait(&op, ec))
+            ec = op.wait();
+
+        return ec;
+    }
+
+    // returns false on timeout, the state can be waited on again afterwards
+    template<typename Clock, typename Duration>
+    bool
+    wait_until(
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        error_code& ec)
+    {
+        static_assert(
+            std::is_same_v<Policy, thread_safe>,
+            "Blocking waits need a thread-safe state");
+
+        if (poll(ec) || ec == errc::broken_sender)
+            return true;
+
+        auto op = timed_wait_op{};
+        ec      = {};
+        if (!start_wait(&op, ec) || op.wait_until(deadline, ec))
+            return true;
+
+        if (cancel_wait(&op))
+        {
+            ec = errc::timeout;
+            return false;
+        }
+
+        // the sender side has taken the operation and is completing it
+        ec = op.wait();
+        return true;
+    }
+
+    // returns the state to empty once the sender side is done with it
+    bool
+    reset() noexcept
+    {
+        // possible vals: empty, engaged, waiting, sent, detached(sender)
+        auto state = state_.load(std::memory_order_acquire);
+
+        if (tag(state) == empty || tag(state) == waiting)
+            return false;
+
+        if (tag(state) != detached)
+            storage_.destroy();
+
+        wait_op_ = nullptr;
+        state_.store(empty, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool
+    is_ready() const noexcept
+    {
+        auto state = state_.load(std::memory_order_relaxed);
+        return tag(state) == sent || tag(state) == engaged;
+    }
+
+    T*
+    get_stored_object() noexcept
+    {
+        auto state = state_.load(std::memory_order_acquire);
+
+        if (tag(state) == sent || tag(state) == engaged)
+            return storage_.object();
+
+        return nullptr;
+    }
+
+    // a single acquire load, the stored object can be accessed if it succeeds
+    bool
+    poll(error_code& ec) const noexcept
+    {
+        // possible vals: empty, engaged, waiting, sent, detached(sender)
+        auto state = state_.load(std::memory_order_acquire);
+
+        if (tag(state) == sent || tag(state) == engaged)
+        {
+            ec = {};
+            return true;
+        }
+
+        ec = tag(state) == detached ? errc::broken_sender : errc::unready;
+        return false;
+    }
+
+    // as poll(), for values packed into the state word
+    std::optional<T>
+    poll_value(error_code& ec) const noexcept
+    {
+        auto state = state_.load(std::memory_order_acquire);
+
+        if (tag(state) == sent || tag(state) == engaged)
+        {
+            ec = {};
+            return decode(state);
+        }
+
+        ec = tag(state) == detached ? errc::broken_sender : errc::unready;
+        return std::nullopt;
+    }
+
+    T*
+    object() noexcept
+    {
+        return storage_.object();
+    }
+};
+
+// Default constructible types still complete with a `T{}` on errors, which is
+// constructed just to be passed along with the error code. Types that can't be
+// default constructed complete with an empty optional instead.
+template<typename T>
+struct async_extract_signature
+{
+    using type = std::conditional_t<
+        std::is_default_constructible_v<T>,
+        void(error_code, T),
+        void(error_code, std::optional<T>)>;
+};
+
+template<>
+struct async_extract_signature<void>
+{
+    using type = void(error_code);
+};
+
+template<typename T>
+using async_extract_signature_t = typename async_extract_signature<T>::type;
+
+template<typename T, typename Policy, class X>
+class shs_handle
+{
+    shared_state<T, Policy>* shared_state_{ nullptr };
+
+  public:
+    shs_handle() noexcept = default;
+    shs_handle(shared_state<T, Policy>* shared_state) noexcept
+        : shared_state_{ shared_state }
+    {
+    }
+
+    shs_handle(shs_handle&& other) noexcept
+    {
+        std::swap(shared_state_, other.shared_state_);
+    }
+
+    shs_handle&
+    operator=(shs_handle&& other) noexcept
+    {
+        std::swap(shared_state_, other.shared_state_);
+        return *this;
+    }
+
+    operator bool() const noexcept
+    {
+        return shared_state_ != nullptr;
+    }
+
+    shared_state<T, Policy>*
+    operator->() const noexcept
+    {
+        return shared_state_;
+    }
+
+    shared_state<T, Policy>*
+    release() noexcept
+    {
+        return std::exchange(shared_state_, nullptr);
+    }
+
+    ~shs_handle()
+    {
+        if (shared_state_)
+            X::detach(shared_state_);
+    }
+};
+
+template<typename T, typename Policy>
+struct sender_shs_handle : shs_handle<T, Policy, sender_shs_handle<T, Policy>>
+{
+    static void
+    detach(shared_state<T, Policy>* p) noexcept
+    {
+        p->sender_detached();
+    }
+};
+
+template<typename T, typename Policy>
+struct receiver_shs_handle
+    : shs_handle<T, Policy, receiver_shs_handle<T, Policy>>
+{
+    static void
+    detach(shared_state<T, Policy>* p) noexcept
+    {
+        p->receiver_detached();
+    }
+};
+
+template<
+    typename T,
+    typename Policy,
+    typename Allocator,
+    std::size_t Align = 1>
+shared_state<T, Policy>*
+allocate_shared_state(Allocator alloc);
+
+// Moves the value out of a settled state, packed values are copied out of the
+// state word.
+template<typename T, typename Policy>
+decltype(auto)
+take_value(receiver_shs_handle<T, Policy>& h)
+{
+    if constexpr (is_packed<T>::value)
+    {
+        auto ec = error_code{};
+        return T{ *h->poll_value(ec) };
+    }
+    else
+    {
+        return std::move(*h->object());
+    }
+}
+
+// Awaits a receiver without an executor: the awaiter is the wait operation and
+// lives in the coroutine frame, the coroutine is resumed inline by the sender
+// side.
+template<typename T, typename Policy>
+class receiver_awaiter final : public wait_op
+{
+    receiver_shs_handle<T, Policy> shs_handle_;
+    std::coroutine_handle<> handle_;
+    error_code ec_;
+
+  public:
+    explicit receiver_awaiter(receiver_shs_handle<T, Policy> shs_handle) noexcept
+        : wait_op{ &wait_op::func<receiver_awaiter> }
+        , shs_handle_{ std::move(shs_handle) }
+    {
+    }
+
+    bool
+    await_ready() noexcept
+    {
+        if (!shs_handle_)
+        {
+            ec_ = errc::no_state;
+            return true;
+        }
+
+        return shs_handle_->poll(ec_) || ec_ == errc::broken_sender;
+    }
+
+    bool
+    await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        handle_ = handle;
+        ec_     = {};
+        return shs_handle_->start_wait(this, ec_);
+    }
+
+    T
+    await_resume()
+    {
+        if (ec_)
+            throw error{ ec_ };
+
+        if constexpr (!std::is_same_v<T, void>)
+            return take_value(shs_handle_);
+    }
+
+    void
+    shutdown() noexcept
+    {
+    }
+
+    void
+    complete(error_code ec)
+    {
+        trace_.post(this);
+        trace_.invoke(this, ec);
+        ec_ = ec;
+        handle_.resume();
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        complete(ec);
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        complete(ec);
+    }
+};
+
+// Completes a wait with the value moved out of the shared state, the state is
+// released once the handler returns.
+template<typename T, typename Policy>
+struct extract_result
+{
+    receiver_shs_handle<T, Policy> shs_handle;
+
+    template<typename Handler>
+    void
+    operator()(Handler&& handler, error_code ec) &&
+    {
+        auto h = std::move(shs_handle);
+
+        if constexpr (std::is_same_v<T, void>)
+            std::move(handler)(ec);
+        else if constexpr (!std::is_default_constructible_v<T>)
+            ec ? std::move(handler)(ec, std::optional<T>{})
+               : std::move(handler)(ec, std::optional<T>{ take_value(h) });
+        else if (ec) // a placeholder, part of the (error_code, T) signature
+            std::move(handler)(ec, T{});
+        else
+            std::move(handler)(ec, take_value(h));
+    }
+};
+
+template<typename F, typename T>
+struct continuation_result
+{
+    using type = std::invoke_result_t<F&, T&&>;
+};
+
+template<typename F>
+struct continuation_result<F, void>
+{
+    using type = std::invoke_result_t<F&>;
+};
+
+// Runs `F` on the value once the sender side settles the upstream state and
+// sends the result into the downstream state, on the same thread. A broken
+// upstream sender, or an exception thrown by `F`, breaks the downstream one.
+template<typename T, typename Policy, typename F>
+class continuation_op final : public wait_op
+{
+    using result_type = typename continuation_result<F, T>::type;
+
+    wait_op_buffer* buffer_;
+    receiver_shs_handle<T, Policy> upstream_;
+    sender_shs_handle<result_type, Policy> downstream_;
+    F f_;
+
+    void
+    forward()
+    {
+        if constexpr (std::is_void_v<T> && std::is_void_v<result_type>)
+        {
+            f_();
+            downstream_->send();
+        }
+        else if constexpr (std::is_void_v<T>)
+        {
+            downstream_->send(f_());
+        }
+        else if constexpr (std::is_void_v<result_type>)
+        {
+            std::invoke(f_, take_value(upstream_));
+            downstream_->send();
+        }
+        else
+        {
+            downstream_->send(std::invoke(f_, take_value(upstream_)));
+        }
+        downstream_.release();
+    }
+
+    void
+    run(error_code ec) noexcept
+    {
+        if (!ec)
+        {
+            try
+            {
+                forward();
+            }
+            catch (...)
+            {
+                // the downstream sender is detached below
+            }
+        }
+        destroy();
+    }
+
+    void
+    destroy() noexcept
+    {
+        auto* buffer = buffer_;
+        this->~continuation_op();
+        if (buffer)
+            buffer->release(buffer);
+        else
+            ::operator delete(this, std::align_val_t{ alignof(continuation_op) });
+    }
+
+  public:
+    continuation_op(
+        wait_op_buffer* buffer,
+        receiver_shs_handle<T, Policy> upstream,
+        sender_shs_handle<result_type, Policy> downstream,
+        F f)
+        : wait_op{ &wait_op::func<continuation_op> }
+        , buffer_{ buffer }
+        , upstream_{ std::move(upstream) }
+        , downstream_{ std::move(downstream) }
+        , f_(std::move(f))
+    {
+    }
+
+    void
+    shutdown() noexcept
+    {
+        destroy();
+    }
+
+    void
+    complete(error_code ec)
+    {
+        run(ec);
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        run(ec);
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        run(ec);
+    }
+};
+
+struct receiver_access
+{
+    template<typename Receiver>
+    static auto*
+    state(Receiver& r)
+    {
+        if (!r.shs_handle_)
+            throw error{ errc::no_state };
+
+        return r.shs_handle_.operator->();
+    }
+
+    // takes over the shared state of `r`, as its rvalue members do
+    template<typename Receiver>
+    static auto
+    take(Receiver& r)
+    {
+        if (!r.shs_handle_)
+            throw error{ errc::no_state };
+
+        return std::move(r.shs_handle_);
+    }
+};
+} // namespace detail
+
+inline send_batch::pending_ops::~pending_ops()
+{
+    for (; next_ < ops_.size(); next_++)
+        ops_[next_].op->shutdown();
+}
+
+template<typename T, typename Policy = thread_safe>
+class sender
+{
+    friend class send_batch;
+
+    detail::sender_shs_handle<T, Policy> shs_handle_;
+
+  public:
+    sender() noexcept = default;
+
+    sender(detail::shared_state<T, Policy>* shared_state) noexcept
+        : shs_handle_{ shared_state }
+    {
+    }
+
+    template<typename... Args>
+    void
+    send(Args&&... args)
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        shs_handle_->send(std::forward<Args>(args)...);
+        shs_handle_.release();
+    }
+
+    // Sends the result of `f()`, which is constructed directly in the shared
+    // state when `f` returns a prvalue `T`.
+    template<typename F>
+    void
+    emplace_with(F&& f)
+    {
+        static_assert(
+            std::is_same_v<std::invoke_result_t<F>, T>,
+            "f must return T by value");
+
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        shs_handle_->send_with(std::forward<F>(f));
+        shs_handle_.release();
+    }
+
+    // Default constructs the value in the shared state and sends it once
+    // `f(T&)` has filled it in place.
+    template<typename F>
+    void
+    fill_with(F&& f)
+    {
+        static_assert(!std::is_same_v<T, void>, "Only for non void senders");
+
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        shs_handle_->send_filled(std::forward<F>(f));
+        shs_handle_.release();
+    }
+};
+
+template<typename T, typename Policy = thread_safe>
+class receiver
+{
+    friend struct detail::receiver_access;
+
+    detail::receiver_shs_handle<T, Policy> shs_handle_;
+
+  public:
+    receiver() noexcept = default;
+
+    receiver(detail::shared_state<T, Policy>* shared_state) noexcept
+        : shs_handle_{ shared_state }
+    {
+    }
+
+    // Awaits the value in any C++20 coroutine without going through an
+    // executor, see detail::receiver_awaiter.
+    auto
+    operator co_await() && noexcept
+    {
+        return detail::receiver_awaiter<T, Policy>{ std::move(shs_handle_) };
+    }
+
+    // Completes with (error_code, T), where T is default constructed on
+    // errors, or with (error_code, std::optional<T>) if T has no default
+    // constructor.
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_extract(CompletionToken&& token = CompletionToken{}) &&
+    {
+        return std::move(*this).async_extract(
+            completion_mode::post, std::forward<CompletionToken>(token));
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_extract(
+        completion_mode mode,
+        CompletionToken&& token = CompletionToken{}) &&
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        auto* state = shs_handle_.operator->();
+        return state->template async_wait<detail::async_extract_signature_t<T>>(
+            mode,
+            std::forward<CompletionToken>(token),
+            detail::extract_result<T, Policy>{ std::move(shs_handle_) });
+    }
+
+    // Runs `f` with the value on the thread that sends it, or right away if it
+    // has been sent already, and returns a receiver for the result. Chained
+    // continuations cost a single completion on the last receiver's executor.
+    // A broken sender, or an exception thrown by `f`, breaks the returned
+    // receiver's sender.
+    template<typename F>
+    auto
+    then(F&& f) &&
+    {
+        using op_type = detail::continuation_op<T, Policy, std::decay_t<F>>;
+        using U = typename detail::continuation_result<std::decay_t<F>, T>::type;
+
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        auto* downstream =
+            detail::allocate_shared_state<U, Policy>(std::allocator<U>{});
+        auto r           = receiver<U, Policy>{ downstream };
+        auto* state      = shs_handle_.operator->();
+        state->template start_op<op_type>(
+            std::move(shs_handle_),
+            detail::sender_shs_handle<U, Policy>{ downstream },
+            std::forward<F>(f));
+        return r;
+    }
+
+    // As async_extract, but completes with errc::timeout once `deadline` has
+    // passed, the receiver is given up either way.
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_extract_until(
+        std::chrono::steady_clock::time_point deadline,
+        CompletionToken&& token = CompletionToken{}) &&
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        auto* state = shs_handle_.operator->();
+        return state->template async_wait<detail::async_extract_signature_t<T>>(
+            completion_mode::post,
+            std::forward<CompletionToken>(token),
+            detail::timed_result<detail::extract_result<T, Policy>>{
+                { std::move(shs_handle_) }, { deadline } });
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_extract_for(
+        std::chrono::steady_clock::duration timeout,
+        CompletionToken&& token = CompletionToken{}) &&
+    {
+        return std::move(*this).async_extract_until(
+            std::chrono::steady_clock::now() + timeout,
+            std::forward<CompletionToken>(token));
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait(CompletionToken&& token = CompletionToken{})
+    {
+        return async_wait(
+            completion_mode::post, std::forward<CompletionToken>(token));
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait(
+        completion_mode mode,
+        CompletionToken&& token = CompletionToken{})
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        return shs_handle_->async_wait(
+            mode, std::forward<CompletionToken>(token));
+    }
+
+    // As async_wait, but completes with errc::timeout once `deadline` has
+    // passed, the state can be waited on again afterwards. Timed waits on an
+    // execution context share a single timer.
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait_until(
+        std::chrono::steady_clock::time_point deadline,
+        CompletionToken&& token = CompletionToken{})
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        return shs_handle_->async_wait(
+            completion_mode::post,
+            std::forward<CompletionToken>(token),
+            detail::timed_result<detail::wait_result>{ {}, { deadline } });
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait_for(
+        std::chrono::steady_clock::duration timeout,
+        CompletionToken&& token = CompletionToken{})
+    {
+        return async_wait_until(
+            std::chrono::steady_clock::now() + timeout,
+            std::forward<CompletionToken>(token));
+    }
+
+    bool
+    is_ready() const
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        return shs_handle_->is_ready();
+    }
+
+    // Returns true if the value has been sent, without suspending.
+    bool
+    try_wait() const
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        auto ec = error_code{};
+        return shs_handle_->poll(ec);
+    }
+
+    // As above, `ec` tells an unready state from a broken sender.
+    bool
+    try_wait(error_code& ec) const noexcept
+    {
+        if (!shs_handle_)
+        {
+            ec = errc::no_state;
+            return false;
+        }
+
+        return shs_handle_->poll(ec);
+    }
+
+    // Blocks the calling thread until the value has been sent, for threads
+    // without an executor. Throws on a broken sender.
+    void
+    wait()
+    {
+        auto ec = error_code{};
+        if (!wait(ec))
+            throw error{ ec };
+    }
+
+    bool
+    wait(error_code& ec)
+    {
+        if (!shs_handle_)
+        {
+            ec = errc::no_state;
+            return false;
+        }
+
+        ec = shs_handle_->wait();
+        return !ec;
+    }
+
+    // Returns false if the value hasn't been sent within the duration, the
+    // receiver can be waited on again afterwards.
+    template<typename Rep, typename Period>
+    bool
+    wait_for(const std::chrono::duration<Rep, Period>& duration)
+    {
+        return wait_until(std::chrono::steady_clock::now() + duration);
+    }
+
+    template<typename Rep, typename Period>
+    bool
+    wait_for(const std::chrono::duration<Rep, Period>& duration, error_code& ec)
+    {
+        return wait_until(std::chrono::steady_clock::now() + duration, ec);
+    }
+
+    template<typename Clock, typename Duration>
+    bool
+    wait_until(const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        auto ec = error_code{};
+        if (wait_until(deadline, ec))
+            return true;
+
+        if (ec == errc::timeout)
+            return false;
+
+        throw error{ ec };
+    }
+
+    template<typename Clock, typename Duration>
+    bool
+    wait_until(
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        error_code& ec)
+    {
+        if (!shs_handle_)
+        {
+            ec = errc::no_state;
+            return false;
+        }
+
+        return shs_handle_->wait_until(deadline, ec) && !ec;
+    }
+
+    // Moves the value out and releases the shared state if the value has been
+    // sent, without suspending.
+    std::optional<T>
+    try_extract()
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        auto ec = error_code{};
+        return try_extract(ec);
+    }
+
+    // As above, `ec` tells an unready state from a broken sender.
+    std::optional<T>
+    try_extract(error_code& ec) noexcept(
+        std::is_nothrow_move_constructible_v<T>)
+    {
+        static_assert(!std::is_same_v<T, void>, "Only for non void receivers");
+
+        if (!shs_handle_)
+        {
+            ec = errc::no_state;
+            return std::nullopt;
+        }
+
+        if constexpr (detail::is_packed<T>::value)
+        {
+            auto value = shs_handle_->poll_value(ec);
+            if (value)
+                shs_handle_ = {};
+            return value;
+        }
+        else
+        {
+            if (!shs_handle_->poll(ec))
+                return std::nullopt;
+
+            auto value = std::optional<T>{ std::move(*shs_handle_->object()) };
+            shs_handle_ = {};
+            return value;
+        }
+    }
+
+    // Reuses the shared state for another round once the value has been sent
+    // or the sender is broken: the stored value is destroyed and a new sender
+    // is returned. A wait on the previous round must have completed.
+    sender<T, Policy>
+    reset()
+    {
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        if (!shs_handle_->reset())
+            throw error{ errc::unready };
+
+        return { shs_handle_.operator->() };
+    }
+
+    // Returns a reference to the stored value, or a copy for values packed
+    // into the state word (see pack_into_state).
+    decltype(auto)
+    get() const
+    {
+        static_assert(!std::is_same_v<T, void>, "Only for non void receivers");
+
+        if (!shs_handle_)
+            throw error{ errc::no_state };
+
+        if constexpr (detail::is_packed<T>::value)
+        {
+            auto ec = error_code{};
+            if (auto v = shs_handle_->poll_value(ec))
+                return T{ *v };
+
+            throw error{ errc::unready };
+        }
+        else
+        {
+            if (auto* p = shs_handle_->get_stored_object())
+                return std::add_lvalue_reference_t<T>(*p);
+
+            throw error{ errc::unready };
+        }
+    }
+};
+
+namespace detail
+{
+// A single operation waiting on a group of receivers. One node per receiver
+// is registered with its shared state, the nodes live in the same allocation
+// and share the reference count that completes the group.
+template<typename State, typename Executor, typename Handler, bool Any>
+class wait_group
+{
+    using policy_type = typename State::policy_type;
+
+    struct node final : wait_op
+    {
+        wait_group* group_;
+        State* state_;
+        std::size_t index_;
+
+        node(wait_group* group, State* state, std::size_t index) noexcept
+            : wait_op{ &wait_op::func<node> }
+            , group_{ group }
+            , state_{ state }
+            , index_{ index }
+        {
+        }
+
+        // the storage belongs to the group
+        void
+        shutdown() noexcept
+        {
+        }
+
+        void
+        complete(error_code ec)
+        {
+            group_->completed(index_, ec);
+        }
+
+        void
+        complete_deferred(error_code ec)
+        {
+            group_->completed(index_, ec);
+        }
+
+        void
+        complete_immediately(error_code ec)
+        {
+            group_->completed(index_, ec);
+        }
+    };
+
+    using r_alloc_t = typename std::allocator_traits<
+        net::associated_allocator_t<Handler>>::template rebind_alloc<node>;
+    using traits_t = std::allocator_traits<r_alloc_t>;
+
+    net::executor_work_guard<Executor> work_guard_;
+    Handler handler_;
+    typename policy_type::template atomic<std::size_t> refs_;
+    typename policy_type::template atomic<bool> decided_{ false };
+    typename policy_type::template atomic<uint8_t> withdrawals_{ 0 };
+    std::size_t size_;
+    std::size_t index_;
+    error_code ec_;
+
+    wait_group(Executor e, Handler handler, std::size_t size)
+        : work_guard_(std::move(e))
+        , handler_(std::move(handler))
+        , refs_{ size + 1 } // one for the initiation
+        , size_{ size }
+        , index_{ size }
+    {
+    }
+
+    static constexpr std::size_t
+    header_elements() noexcept
+    {
+        return (sizeof(wait_group) + sizeof(node) - 1) / sizeof(node);
+    }
+
+    node*
+    nodes() noexcept
+    {
+        return reinterpret_cast<node*>(this) + header_elements();
+    }
+
+    void
+    completed(std::size_t index, error_code ec)
+    {
+        if (Any || ec)
+            decide(index, ec);
+        release();
+    }
+
+    void
+    decide(std::size_t index, error_code ec)
+    {
+        if (decided_.exchange(true, std::memory_order_acq_rel))
+            return;
+
+        index_ = index;
+        ec_    = ec;
+        withdraw();
+    }
+
+    // the later of a decision and the end of the initiation withdraws the
+    // nodes that are still registered
+    void
+    withdraw()
+    {
+        if (withdrawals_.fetch_add(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        for (std::size_t i = 0; i < size_; i++)
+        {
+            auto& n = nodes()[i];
+            if (n.state_->cancel_wait(&n))
+                release();
+        }
+    }
+
+    // takes a reference for a cancellation unless the group has already
+    // been decided or its completion has been posted
+    bool
+    claim() noexcept
+    {
+        if (decided_.load(std::memory_order_acquire))
+            return false;
+
+        auto refs = refs_.load(std::memory_order_relaxed);
+        do
+        {
+            if (refs == 0)
+                return false;
+        } while (!refs_.compare_exchange_weak(
+            refs, refs + 1, std::memory_order_acquire));
+        return true;
+    }
+
+    void
+    release(bool immediately = false, bool cancelling = false)
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        // the slot's handler may still run until the completion clears the
+        // slot, unless it is the one completing the group
+        if (cancelling)
+            net::get_associated_cancellation_slot(handler_).clear();
+
+        if (immediately)
+        {
+#ifdef ONESHOT_HAS_IMMEDIATE_EXECUTOR
+            auto exec = net::get_associated_immediate_executor(
+                handler_, work_guard_.get_executor());
+            net::dispatch(exec, completion());
+#else
+            net::post(work_guard_.get_executor(), completion());
+#endif
+        }
+        else
+        {
+            net::post(work_guard_.get_executor(), completion());
+        }
+    }
+
+    auto
+    completion()
+    {
+        return [this]()
+        {
+            net::get_associated_cancellation_slot(handler_).clear();
+            auto g     = std::move(work_guard_);
+            auto h     = std::move(handler_);
+            auto ec    = ec_;
+            auto index = index_;
+            destroy(this, net::get_associated_allocator(h));
+
+            if constexpr (Any)
+                std::move(h)(ec, index);
+            else
+                std::move(h)(ec);
+        };
+    }
+
+    static void
+    destroy(wait_group* self, net::associated_allocator_t<Handler> halloc)
+    {
+        auto alloc = r_alloc_t(halloc);
+        auto count = header_elements() + self->size_;
+        std::destroy_n(self->nodes(), self->size_);
+        self->~wait_group();
+        traits_t::deallocate(alloc, reinterpret_cast<node*>(self), count);
+    }
+
+  public:
+    template<typename Iterator>
+    static void
+    start(Executor e, Handler handler, Iterator first, std::size_t size)
+    {
+        static_assert(alignof(wait_group) <= alignof(node));
+
+        auto alloc = r_alloc_t(net::get_associated_allocator(handler));
+        auto* mem  = traits_t::allocate(alloc, header_elements() + size);
+        wait_group* self;
+
+        try
+        {
+            self = new (mem) wait_group(std::move(e), std::move(handler), size);
+        }
+        catch (...)
+        {
+            traits_t::deallocate(alloc, mem, header_elements() + size);
+            throw;
+        }
+
+        for (std::size_t i = 0; i < size; i++, ++first)
+        {
+            auto* state = receiver_access::state(*first);
+            auto* n     = new (self->nodes() + i) node{ self, state, i };
+            auto ec     = error_code{};
+            if (!state->start_wait(n, ec))
+                self->completed(i, ec);
+        }
+
+        auto c_slot = net::get_associated_cancellation_slot(self->handler_);
+        if (c_slot.is_connected())
+        {
+            c_slot.assign(
+                [self](net::cancellation_type type)
+                {
+                    if (type != net::cancellation_type::none && self->claim())
+                    {
+                        self->decide(self->size_, errc::cancelled);
+                        self->release(false, true);
+                    }
+                });
+        }
+
+        self->withdraw();
+        self->release(true);
+    }
+};
+
+template<bool Any, typename Range, typename CompletionToken>
+auto
+async_wait_group(Range& receivers, CompletionToken&& token)
+{
+    using signature = std::conditional_t<
+        Any,
+        void(error_code, std::size_t),
+        void(error_code)>;
+
+    // validate up front, throwing from within the initiation would leave
+    // nodes registered
+    auto size = std::size_t{ 0 };
+    for (auto& r : receivers)
+    {
+        receiver_access::state(r);
+        size++;
+    }
+
+    if (Any && size == 0)
+        throw error{ errc::no_state };
+
+    return net::async_initiate<CompletionToken, signature>(
+        [](auto handler, Range* receivers, std::size_t size)
+        {
+            auto exec = net::get_associated_executor(handler);
+
+            using state_type = std::remove_pointer_t<
+                decltype(receiver_access::state(*std::begin(*receivers)))>;
+            using group_type = wait_group<
+                state_type,
+                decltype(exec),
+                std::decay_t<decltype(handler)>,
+                Any>;
+
+            group_type::start(
+                std::move(exec), std::move(handler), std::begin(*receivers), size);
+        },
+        token,
+        &receivers,
+        size);
+}
+} // namespace detail
+
+// Waits until every receiver in the range is ready, or completes with the
+// first error and withdraws from the remaining receivers.
+template<typename Range, typename CompletionToken = net::deferred_t>
+auto
+async_wait_all(Range& receivers, CompletionToken&& token = CompletionToken{})
+{
+    return detail::async_wait_group<false>(
+        receivers, std::forward<CompletionToken>(token));
+}
+
+// Waits until any receiver in the range is ready or its sender is broken,
+// completes with its index and withdraws from the others, which can be waited
+// on again. On cancellation the index is the size of the range.
+template<typename Range, typename CompletionToken = net::deferred_t>
+auto
+async_wait_any(Range& receivers, CompletionToken&& token = CompletionToken{})
+{
+    return detail::async_wait_group<true>(
+        receivers, std::forward<CompletionToken>(token));
+}
+
+namespace detail
+{
+template<typename Policy>
+class broadcast_waiters;
+
+// A wait linked into the waiter list of a broadcast state. Whichever of the
+// sender side and a cancellation claims it first completes it, the list keeps
+// a reference until the sender side or a cancellation has unlinked it.
+template<typename Policy>
+struct broadcast_wait_op : wait_op
+{
+    broadcast_wait_op* next_{ nullptr };
+    typename Policy::template atomic<bool> claimed_{ false };
+    // one for the completion and one while linked into the list
+    typename Policy::template atomic<uint8_t> refs_{ 1 };
+    // kept alive while the cancellation handler can unlink waits from it
+    broadcast_waiters<Policy>* waiters_{ nullptr };
+
+    using wait_op::wait_op;
+
+    bool
+    claim() noexcept
+    {
+        return !claimed_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    bool
+    claimed() const noexcept
+    {
+        return claimed_.load(std::memory_order_acquire);
+    }
+
+    // the last reference destroys the operation through its shutdown()
+    void
+    release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            shutdown();
+    }
+
+  protected:
+    ~broadcast_wait_op() = default;
+};
+
+template<typename Policy, class Executor, class Handler>
+class broadcast_wait_op_model final : public broadcast_wait_op<Policy>
+{
+    using r_alloc_t = typename std::allocator_traits<
+        net::associated_allocator_t<Handler>>::
+        template rebind_alloc<broadcast_wait_op_model>;
+    using traits_t = std::allocator_traits<r_alloc_t>;
+
+    net::executor_work_guard<Executor> work_guard_;
+    Handler handler_;
+    completion_mode mode_;
+    // the handler is gone by the time the list lets go of the operation
+    [[no_unique_address]] r_alloc_t alloc_;
+
+    auto
+    completion(error_code ec)
+    {
+        return [this, ec]()
+        {
+            get_cancellation_slot().clear();
+            this->trace_.invoke(this, ec);
+            auto g = std::move(work_guard_);
+            auto h = std::move(handler_);
+            auto* waiters = std::exchange(this->waiters_, nullptr);
+            this->release();
+            if (waiters)
+                waiters->release();
+            std::move(h)(ec);
+        };
+    }
+
+  public:
+    broadcast_wait_op_model(Executor e, Handler handler, completion_mode mode)
+        : broadcast_wait_op<Policy>{ &wait_op::func<broadcast_wait_op_model> }
+        , work_guard_(std::move(e))
+        , handler_(std::move(handler))
+        , mode_(mode)
+        , alloc_(net::get_associated_allocator(handler_))
+    {
+    }
+
+    [[nodiscard]] auto
+    get_cancellation_slot() const noexcept
+    {
+        return net::get_associated_cancellation_slot(handler_);
+    }
+
+    static broadcast_wait_op_model*
+    construct(Executor e, Handler handler, completion_mode mode)
+    {
+        auto alloc = r_alloc_t(net::get_associated_allocator(handler));
+        auto* mem  = traits_t::allocate(alloc, 1);
+
+        try
+        {
+            return new (mem) broadcast_wait_op_model(
+                std::move(e), std::move(handler), mode);
+        }
+        catch (...)
+        {
+            traits_t::deallocate(alloc, mem, 1);
+            throw;
+        }
+    }
+
+    // runs once both the completion and the list have let go
+    void
+    shutdown() noexcept
+    {
+        auto alloc = alloc_; // copy before destroy
+        this->~broadcast_wait_op_model();
+        traits_t::deallocate(alloc, this, 1);
+    }
+
+    void
+    complete(error_code ec)
+    {
+        this->trace_.post(this);
+        if (mode_ == completion_mode::dispatch)
+            net::dispatch(work_guard_.get_executor(), completion(ec));
+        else
+            net::post(work_guard_.get_executor(), completion(ec));
+    }
+
+    void
+    complete_deferred(error_code ec)
+    {
+        this->trace_.post(this);
+        net::post(work_guard_.get_executor(), completion(ec));
+    }
+
+    void
+    complete_immediately(error_code ec)
+    {
+        this->trace_.post(this);
+#ifdef ONESHOT_HAS_IMMEDIATE_EXECUTOR
+        auto exec = net::get_associated_immediate_executor(
+            handler_, work_guard_.get_executor());
+        net::dispatch(exec, completion(ec));
+#else
+        net::post(work_guard_.get_executor(), completion(ec));
+#endif
+    }
+};
+
+// The lock-free waiter list and reference count of a broadcast state. Waits
+// are pushed onto the list, which the sender side closes and walks once. A
+// cancellation takes the list over to unlink the waits it has claimed and
+// splices the rest back.
+template<typename Policy>
+class broadcast_waiters
+{
+  protected:
+    using op_type = broadcast_wait_op<Policy>;
+
+    // list heads after the sender side is done
+    static constexpr std::uintptr_t sent   = 1;
+    static constexpr std::uintptr_t broken = 2;
+
+    typename Policy::template atomic<std::uintptr_t> head_{ 0 };
+    typename Policy::template atomic<std::size_t> refs_{ 2 };
+    void (*deallocate_)(broadcast_waiters*) noexcept;
+
+    static bool
+    closed(std::uintptr_t head) noexcept
+    {
+        return head == sent || head == broken;
+    }
+
+    // completes the waits of `ops`, which is in reverse order of the waits
+    static void
+    complete(op_type* ops, error_code ec, trace_clock::time_point t)
+    {
+        op_type* ordered = nullptr;
+        for (auto* op = ops; op;)
+            op = std::exchange(op->next_, std::exchange(ordered, op));
+
+        while (ordered)
+        {
+            auto* op = std::exchange(ordered, ordered->next_);
+            if (op->claim())
+            {
+                op->trace_.signal(t);
+                op->complete(ec);
+            }
+            op->release();
+        }
+    }
+
+    void
+    close(std::uintptr_t tag, error_code ec)
+    {
+        auto t = trace(
+            tag == sent ? trace_event::send : trace_event::broken_sender, this);
+        auto head = head_.exchange(tag, std::memory_order_acq_rel);
+        complete(reinterpret_cast<op_type*>(head), ec, t);
+    }
+
+    // pushes `op` unless the list has been closed, returns the list head
+    std::uintptr_t
+    push(op_type* op) noexcept
+    {
+        auto head = head_.load(std::memory_order_acquire);
+        do
+        {
+            if (closed(head))
+                return head;
+            op->next_ = reinterpret_cast<op_type*>(head);
+        } while (!head_.compare_exchange_weak(
+            head,
+            reinterpret_cast<std::uintptr_t>(op),
+            std::memory_order_release,
+            std::memory_order_acquire));
+        return 0;
+    }
+
+  public:
+    explicit broadcast_waiters(
+        void (*deallocate)(broadcast_waiters*) noexcept) noexcept
+        : deallocate_{ deallocate }
+    {
+    }
+
+    broadcast_waiters(const broadcast_waiters&) = delete;
+
+    void
+    add_ref() noexcept
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            deallocate_(this);
+    }
+
+    // unlinks the claimed waits, so repeated cancellations without a send
+    // don't keep their operations alive
+    void
+    prune()
+    {
+        auto head = head_.load(std::memory_order_acquire);
+        do
+        {
+            if (head == 0 || closed(head))
+                return;
+        } while (!head_.compare_exchange_weak(
+            head, 0, std::memory_order_acquire, std::memory_order_acquire));
+
+        op_type* kept  = nullptr;
+        op_type** tail = &kept;
+        for (auto* op = reinterpret_cast<op_type*>(head); op;)
+        {
+            auto* next = op->next_;
+            if (op->claimed())
+            {
+                op->release();
+            }
+            else
+            {
+                *tail = op;
+                tail  = &op->next_;
+            }
+            op = next;
+        }
+        *tail = nullptr;
+
+        // the waits made in the meantime go on top of the kept ones
+        head = 0;
+        while (kept)
+        {
+            if (closed(head))
+            {
+                auto ec = head == sent ? error_code{} : errc::broken_sender;
+                return complete(kept, ec, {});
+            }
+
+            if (head == 0)
+            {
+                if (head_.compare_exchange_weak(
+                        head,
+                        reinterpret_cast<std::uintptr_t>(kept),
+                        std::memory_order_release,
+                        std::memory_order_acquire))
+                    return;
+                continue;
+            }
+
+            if (!head_.compare_exchange_weak(
+                    head, 0, std::memory_order_acquire, std::memory_order_acquire))
+                continue;
+
+            auto* newer = reinterpret_cast<op_type*>(head);
+            auto* last  = newer;
+            while (last->next_)
+                last = last->next_;
+            last->next_ = std::exchange(kept, newer);
+            head        = 0;
+        }
+    }
+};
+
+// Shared state of a single sender and any number of receivers.
+template<typename T, typename Policy = thread_safe>
+class broadcast_state : public broadcast_waiters<Policy>
+{
+    using base_type = broadcast_waiters<Policy>;
+    using typename base_type::op_type;
+    using base_type::broken;
+    using base_type::head_;
+    using base_type::sent;
+
+    [[no_unique_address]] storage<T> storage_;
+
+  public:
+    using base_type::base_type;
+
+    ~broadcast_state()
+    {
+        if (head_.load(std::memory_order_relaxed) == sent)
+            storage_.destroy();
+    }
+
+    template<typename... Args>
+    void
+    send(Args&&... args)
+    {
+        storage_.construct(std::forward<Args>(args)...);
+        this->close(sent, {});
+    }
+
+    void
+    sender_detached() noexcept
+    {
+        this->close(broken, errc::broken_sender);
+    }
+
+    template<typename CompletionToken>
+    auto
+    async_wait(completion_mode mode, CompletionToken&& token)
+    {
+        return net::async_initiate<decltype(token), void(error_code)>(
+            [this, mode](auto handler)
+            {
+                auto exec = net::get_associated_executor(handler);
+
+                using model_type = broadcast_wait_op_model<
+                    Policy,
+                    decltype(exec),
+                    std::decay_t<decltype(handler)>>;
+
+                auto* model = model_type::construct(
+                    std::move(exec), std::move(handler), mode);
+                auto c_slot = model->get_cancellation_slot();
+                if (c_slot.is_connected())
+                {
+                    this->add_ref();
+                    model->waiters_ = this;
+                    c_slot.assign(
+                        [this, model](net::cancellation_type type)
+                        {
+                            if (type != net::cancellation_type::none &&
+                                model->claim())
+                            {
+                                trace(trace_event::cancel, this);
+                                this->prune();
+                                model->complete_deferred(errc::cancelled);
+                            }
+                        });
+                }
+
+                trace(trace_event::wait, this);
+                model->refs_.store(2, std::memory_order_relaxed);
+                if (auto head = this->push(model))
+                {
+                    model->refs_.store(1, std::memory_order_relaxed);
+                    model->claim();
+                    return model->complete_immediately(
+                        head == sent ? error_code{} : errc::broken_sender);
+                }
+            },
+            token);
+    }
+
+    bool
+    is_ready() const noexcept
+    {
+        return head_.load(std::memory_order_relaxed) == sent;
+    }
+
+    T*
+    get_stored_object() noexcept
+    {
+        if (head_.load(std::memory_order_acquire) == sent)
+            return storage_.object();
+
+        return nullptr;
+    }
+};
+
+template<typename T, typename Policy, typename Allocator>
+broadcast_state<T, Policy>*
+allocate_broadcast_state(Allocator alloc)
+{
+    struct wrapper : broadcast_state<T, Policy>
+    {
+        [[no_unique_address]] Allocator alloc_;
+
+        explicit wrapper(Allocator alloc)
+            : broadcast_state<T, Policy>{ &deallocate }
+            , alloc_{ alloc }
+        {
+        }
+
+        static void
+        deallocate(broadcast_waiters<Policy>* p) noexcept
+        {
+            using r_alloc_t = typename std::allocator_traits<
+                Allocator>::template rebind_alloc<wrapper>;
+            using traits_t = std::allocator_traits<r_alloc_t>;
+            auto* self     = static_cast<wrapper*>(p);
+            auto r_alloc   = r_alloc_t{ self->alloc_ }; // copy before destroy
+            traits_t::destroy(r_alloc, self);
+            traits_t::deallocate(r_alloc, self, 1);
+        }
+    };
+
+    using r_alloc_t = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<wrapper>;
+    using traits_t = std::allocator_traits<r_alloc_t>;
+    auto r_alloc   = r_alloc_t{ alloc };
+    auto* p        = traits_t::allocate(r_alloc, 1);
+    traits_t::construct(r_alloc, p, alloc); // noexcept
+    trace(trace_event::create, p);
+    return p;
+}
+} // namespace detail
+
+// Sending side of a broadcast, completes every wait on its receivers.
+template<typename T, typename Policy = thread_safe>
+class broadcast_sender
+{
+    detail::broadcast_state<T, Policy>* state_{ nullptr };
+
+  public:
+    broadcast_sender() noexcept = default;
+
+    broadcast_sender(detail::broadcast_state<T, Policy>* state) noexcept
+        : state_{ state }
+    {
+    }
+
+    broadcast_sender(broadcast_sender&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+    }
+
+    broadcast_sender&
+    operator=(broadcast_sender&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+        return *this;
+    }
+
+    ~broadcast_sender()
+    {
+        if (state_)
+        {
+            state_->sender_detached();
+            state_->release();
+        }
+    }
+
+    template<typename... Args>
+    void
+    send(Args&&... args)
+    {
+        if (!state_)
+            throw error{ errc::no_state };
+
+        state_->send(std::forward<Args>(args)...);
+        std::exchange(state_, nullptr)->release();
+    }
+};
+
+// Copyable receiving side of a broadcast, any number of waits can be pending
+// on each copy and the value is read in place.
+template<typename T, typename Policy = thread_safe>
+class shared_receiver
+{
+    detail::broadcast_state<T, Policy>* state_{ nullptr };
+
+  public:
+    shared_receiver() noexcept = default;
+
+    shared_receiver(detail::broadcast_state<T, Policy>* state) noexcept
+        : state_{ state }
+    {
+    }
+
+    shared_receiver(const shared_receiver& other) noexcept
+        : state_{ other.state_ }
+    {
+        if (state_)
+            state_->add_ref();
+    }
+
+    shared_receiver(shared_receiver&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+    }
+
+    shared_receiver&
+    operator=(shared_receiver other) noexcept
+    {
+        std::swap(state_, other.state_);
+        return *this;
+    }
+
+    ~shared_receiver()
+    {
+        if (state_)
+            state_->release();
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait(CompletionToken&& token = CompletionToken{}) const
+    {
+        return async_wait(
+            completion_mode::post, std::forward<CompletionToken>(token));
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait(
+        completion_mode mode,
+        CompletionToken&& token = CompletionToken{}) const
+    {
+        if (!state_)
+            throw error{ errc::no_state };
+
+        return state_->async_wait(mode, std::forward<CompletionToken>(token));
+    }
+
+    bool
+    is_ready() const
+    {
+        if (!state_)
+            throw error{ errc::no_state };
+
+        return state_->is_ready();
+    }
+
+    const auto&
+    get() const
+    {
+        static_assert(!std::is_same_v<T, void>, "Only for non void receivers");
+
+        if (!state_)
+            throw error{ errc::no_state };
+
+        if (auto* p = state_->get_stored_object())
+            return std::as_const(*p);
+
+        throw error{ errc::unready };
+    }
+};
+
+namespace detail
+{
+// Kept next to the shared state of a latch, the last arrival sends the number
+// of senders that were destroyed without sending.
+template<typename Policy>
+struct latch_counters
+{
+    typename Policy::template atomic<std::size_t> pending_{ 1 };
+    typename Policy::template atomic<std::size_t> broken_{ 0 };
+    sender_shs_handle<std::size_t, Policy> sender_;
+
+    void
+    join() noexcept
+    {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    arrive(bool broken) noexcept
+    {
+        if (broken)
+            broken_.fetch_add(1, std::memory_order_relaxed);
+
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // the send frees the block holding `this` once the receiver is
+            // gone, nothing here may be touched after it
+            auto broken = broken_.load(std::memory_order_relaxed);
+            sender_.release()->send(broken);
+        }
+    }
+};
+} // namespace detail
+
+// Copyable sending side of a latch, every copy is a participant. The latch's
+// receiver completes once all of them have sent or have been destroyed, with
+// the number of the latter.
+template<typename Policy = thread_safe>
+class latch_sender
+{
+    detail::latch_counters<Policy>* counters_{ nullptr };
+
+  public:
+    latch_sender() noexcept = default;
+
+    explicit latch_sender(detail::latch_counters<Policy>* counters) noexcept
+        : counters_{ counters }
+    {
+    }
+
+    latch_sender(const latch_sender& other) noexcept
+        : counters_{ other.counters_ }
+    {
+        if (counters_)
+            counters_->join();
+    }
+
+    latch_sender(latch_sender&& other) noexcept
+        : counters_{ std::exchange(other.counters_, nullptr) }
+    {
+    }
+
+    latch_sender&
+    operator=(latch_sender other) noexcept
+    {
+        std::swap(counters_, other.counters_);
+        return *this;
+    }
+
+    ~latch_sender()
+    {
+        if (counters_)
+            counters_->arrive(true);
+    }
+
+    void
+    send()
+    {
+        if (!counters_)
+            throw error{ errc::no_state };
+
+        std::exchange(counters_, nullptr)->arrive(false);
+    }
+};
+
+namespace detail
+{
+struct no_extra
+{
+};
+
+// A shared state allocated on its own, next to its wait operation storage and
+// `Extra`, which types built on top of the shared state keep their data in.
+template<
+    typename T,
+    typename Policy,
+    typename Allocator,
+    std::size_t Align = 1,
+    typename Extra    = no_extra>
+struct alignas(std::max(
+    { Align,
+      alignof(shared_state<T, Policy>),
+      alignof(wait_op_storage<Policy, ONESHOT_WAIT_OP_BUFFER_SIZE>),
+      alignof(Extra),
+      alignof(Allocator) })) shared_state_block
+    : shared_state<T, Policy>
+    , wait_op_storage<Policy, ONESHOT_WAIT_OP_BUFFER_SIZE>
+    , Extra
+{
+    using buffer_type = wait_op_storage<Policy, ONESHOT_WAIT_OP_BUFFER_SIZE>;
+
+    [[no_unique_address]] Allocator alloc_;
+
+    explicit shared_state_block(Allocator alloc)
+        : shared_state<T, Policy>{ &manage }
+        , buffer_type{ &deallocate_buffer }
+        , alloc_{ alloc }
+    {
+    }
+
+    static shared_state_block*
+    allocate(Allocator alloc)
+    {
+        using r_alloc_t = typename std::allocator_traits<
+            Allocator>::template rebind_alloc<shared_state_block>;
+        using traits_t = std::allocator_traits<r_alloc_t>;
+        auto r_alloc   = r_alloc_t{ alloc };
+        auto* p        = traits_t::allocate(r_alloc, 1);
+        traits_t::construct(r_alloc, p, alloc); // noexcept
+        trace(trace_event::create, static_cast<shared_state<T, Policy>*>(p));
+        return p;
+    }
+
+    static void
+    deallocate(shared_state_block* p) noexcept
+    {
+        using r_alloc_t = typename std::allocator_traits<
+            Allocator>::template rebind_alloc<shared_state_block>;
+        using traits_t = std::allocator_traits<r_alloc_t>;
+        auto r_alloc   = r_alloc_t{ p->alloc_ }; // copy before destroy
+        traits_t::destroy(r_alloc, p);
+        traits_t::deallocate(r_alloc, p, 1);
+    }
+
+    static void
+    deallocate_buffer(basic_wait_op_buffer<Policy>* p) noexcept
+    {
+        if constexpr (std::is_base_of_v<basic_wait_op_buffer<Policy>, buffer_type>)
+            deallocate(static_cast<shared_state_block*>(
+                static_cast<buffer_type*>(p)));
+    }
+
+    static void*
+    manage(shared_state<T, Policy>* p, block_op op) noexcept
+    {
+        auto* self = static_cast<shared_state_block*>(p);
+
+        if (op == block_op::deallocate)
+        {
+            deallocate(self);
+            return nullptr;
+        }
+
+        if (op == block_op::memory_resource)
+            return memory_resource_of(self->alloc_);
+
+        if (op == block_op::shared_wait_op_buffer)
+            return nullptr;
+
+        if constexpr (std::is_base_of_v<basic_wait_op_buffer<Policy>, buffer_type>)
+            return static_cast<basic_wait_op_buffer<Policy>*>(self);
+        else
+            return nullptr;
+    }
+};
+
+template<
+    typename T,
+    typename Policy,
+    typename Allocator,
+    std::size_t Align>
+shared_state<T, Policy>*
+allocate_shared_state(Allocator alloc)
+{
+    return shared_state_block<T, Policy, Allocator, Align>::allocate(alloc);
+}
+
+// A contiguous block of shared states, freed once the last of them is
+// released. The states share a single wait operation buffer at the end of
+// the block, an operation still constructed in it keeps the block alive.
+template<
+    typename T,
+    typename Policy,
+    typename Allocator,
+    std::size_t Align = 1>
+class state_arena : basic_wait_op_buffer<Policy>
+{
+    struct alignas(std::max(
+        { Align, alignof(shared_state<T, Policy>), alignof(void*) })) element
+        : shared_state<T, Policy>
+    {
+        state_arena* arena_;
+
+        explicit element(state_arena* arena) noexcept
+            : shared_state<T, Policy>{ &manage }
+            , arena_{ arena }
+        {
+        }
+
+        static void*
+        manage(shared_state<T, Policy>* p, block_op op) noexcept
+        {
+            // no storage of its own, it would spread the states apart
+            auto* arena = static_cast<element*>(p)->arena_;
+            if (op == block_op::deallocate)
+                arena->release();
+            if (op == block_op::memory_resource)
+                return memory_resource_of(arena->alloc_);
+            if (op == block_op::shared_wait_op_buffer)
+                return static_cast<basic_wait_op_buffer<Policy>*>(arena);
+            return nullptr;
+        }
+    };
+
+    using r_alloc_t =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<element>;
+    using traits_t = std::allocator_traits<r_alloc_t>;
+
+    typename Policy::template atomic<std::size_t> refs_;
+    std::size_t size_;
+    [[no_unique_address]] Allocator alloc_;
+
+    state_arena(std::size_t size, Allocator alloc, unsigned char* buffer) noexcept
+        : basic_wait_op_buffer<Policy>{ buffer,
+                                        ONESHOT_WAIT_OP_BUFFER_SIZE,
+                                        &deallocate_buffer }
+        , refs_{ size }
+        , size_{ size }
+        , alloc_{ alloc }
+    {
+    }
+
+    static constexpr std::size_t
+    header_elements() noexcept
+    {
+        return (sizeof(state_arena) + sizeof(element) - 1) / sizeof(element);
+    }
+
+    // room for the buffer and for aligning it past the last state
+    static constexpr std::size_t
+    buffer_elements() noexcept
+    {
+        if constexpr (ONESHOT_WAIT_OP_BUFFER_SIZE == 0)
+            return 0;
+        else
+            return (ONESHOT_WAIT_OP_BUFFER_SIZE + alignof(std::max_align_t) +
+                    sizeof(element) - 1) /
+                sizeof(element);
+    }
+
+    static unsigned char*
+    buffer_of(element* end) noexcept
+    {
+        constexpr auto align = alignof(std::max_align_t);
+        auto p               = reinterpret_cast<std::uintptr_t>(end);
+        return reinterpret_cast<unsigned char*>((p + align - 1) & ~(align - 1));
+    }
+
+    element*
+    elements() noexcept
+    {
+        return reinterpret_cast<element*>(this) + header_elements();
+    }
+
+    void
+    release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        if (this->orphan())
+            deallocate();
+    }
+
+    void
+    deallocate() noexcept
+    {
+        auto r_alloc = r_alloc_t{ alloc_ }; // copy before destroy
+        auto count   = header_elements() + size_ + buffer_elements();
+        std::destroy_n(elements(), size_);
+        this->~state_arena();
+        traits_t::deallocate(r_alloc, reinterpret_cast<element*>(this), count);
+    }
+
+    static void
+    deallocate_buffer(basic_wait_op_buffer<Policy>* p) noexcept
+    {
+        static_cast<state_arena*>(p)->deallocate();
+    }
+
+  public:
+    template<typename F>
+    static void
+    create(std::size_t size, Allocator alloc, F&& f)
+    {
+        static_assert(alignof(state_arena) <= alignof(element));
+
+        if (size == 0)
+            return;
+
+        auto r_alloc = r_alloc_t{ alloc };
+        auto* mem    = traits_t::allocate(
+            r_alloc, header_elements() + size + buffer_elements());
+        auto* arena  = new (mem) state_arena{
+            size, alloc, buffer_of(mem + header_elements() + size)
+        };
+        auto* first  = arena->elements();
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            trace(trace_event::create, first + i);
+            f(new (first + i) element{ arena });
+        }
+    }
+};
+
+template<
+    typename T,
+    typename Policy,
+    std::size_t Align = 1,
+    typename Allocator>
+std::pair<std::vector<sender<T, Policy>>, std::vector<receiver<T, Policy>>>
+create_n(std::size_t n, Allocator alloc)
+{
+    auto result = std::pair<
+        std::vector<sender<T, Policy>>,
+        std::vector<receiver<T, Policy>>>{};
+    result.first.reserve(n);
+    result.second.reserve(n);
+
+    state_arena<T, Policy, Allocator, Align>::create(
+        n,
+        alloc,
+        [&](shared_state<T, Policy>* p) noexcept
+        {
+            result.first.emplace_back(p);
+            result.second.emplace_back(p);
+        });
+
+    return result;
+}
+} // namespace detail
+
+namespace detail
+{
+struct free_block
+{
+    free_block* next;
+    free_block* next_batch;
+    std::size_t batch_size;
+};
+
+// Free lists for a single size class. Each thread caches blocks locally and
+// hands surplus to a process-wide depot in batches, so blocks that keep being
+// released on a different thread from the one that allocated them are
+// balanced back to the allocating threads.
+template<std::size_t Size, std::size_t Align>
+class block_pool
+{
+    static constexpr std::size_t batch = 64;
+
+    class depot
+    {
+        std::mutex mutex_;
+        free_block* batches_{ nullptr };
+
+      public:
+        void
+        push(free_block* head, std::size_t size) noexcept
+        {
+            head->batch_size = size;
+            auto lock        = std::lock_guard{ mutex_ };
+            head->next_batch = std::exchange(batches_, head);
+        }
+
+        free_block*
+        pop() noexcept
+        {
+            auto lock = std::lock_guard{ mutex_ };
+            if (auto* head = batches_)
+            {
+                batches_ = head->next_batch;
+                return head;
+            }
+            return nullptr;
+        }
+
+        ~depot()
+        {
+            while (auto* head = batches_)
+            {
+                batches_ = head->next_batch;
+                while (head)
+                    release(std::exchange(head, head->next));
+            }
+        }
+    };
+
+    class cache
+    {
+        free_block* head_{ nullptr };
+        std::size_t size_{ 0 };
+
+      public:
+        void*
+        allocate()
+        {
+            if (!head_)
+            {
+                head_ = global().pop();
+                if (!head_)
+                    return ::operator new(Size, std::align_val_t{ Align });
+                size_ = head_->batch_size;
+            }
+
+            size_--;
+            return std::exchange(head_, head_->next);
+        }
+
+        void
+        deallocate(void* p) noexcept
+        {
+            auto* block = static_cast<free_block*>(p);
+            block->next = std::exchange(head_, block);
+
+            if (++size_ < 2 * batch)
+                return;
+
+            // keep one batch, hand the rest over to the depot
+            auto* tail = head_;
+            for (std::size_t i = 1; i < batch; i++)
+                tail = tail->next;
+            global().push(std::exchange(tail->next, nullptr), size_ - batch);
+            size_ = batch;
+        }
+
+        ~cache()
+        {
+            if (head_)
+                global().push(head_, size_);
+        }
+    };
+
+    static depot&
+    global() noexcept
+    {
+        static depot d;
+        return d;
+    }
+
+    static cache&
+    local() noexcept
+    {
+        thread_local cache c;
+        return c;
+    }
+
+    static void
+    release(void* p) noexcept
+    {
+        ::operator delete(p, std::align_val_t{ Align });
+    }
+
+  public:
+    static void*
+    allocate()
+    {
+        return local().allocate();
+    }
+
+    static void
+    deallocate(void* p) noexcept
+    {
+        local().deallocate(p);
+    }
+};
+
+// Free blocks kept for an execution context, in size classes of cache lines.
+// Blocks are first touched by the thread that reserves them, so where memory
+// is placed on the NUMA node of the thread touching it first they stay near
+// the context's threads however far the allocating thread is. Deallocation
+// returns blocks to the pool from any thread; the pool outlives its context
+// until the last block allocated from it is returned.
+class context_pool
+{
+    static constexpr std::size_t line    = ONESHOT_CACHE_LINE_SIZE;
+    static constexpr std::size_t classes = 32;
+
+    std::mutex mutex_;
+    std::array<free_block*, classes> free_{};
+    std::size_t outstanding_{ 0 };
+    bool orphaned_{ false };
+
+    static std::size_t
+    index(std::size_t size) noexcept
+    {
+        return (size - 1) / line;
+    }
+
+    static void*
+    allocate_block(std::size_t i)
+    {
+        return ::operator new((i + 1) * line, std::align_val_t{ line });
+    }
+
+    ~context_pool()
+    {
+        for (auto* head : free_)
+            while (head)
+                ::operator delete(
+                    std::exchange(head, head->next), std::align_val_t{ line });
+    }
+
+  public:
+    static constexpr bool
+    fits(std::size_t size, std::size_t align) noexcept
+    {
+        return size >= sizeof(free_block) && size <= classes * line &&
+            align <= line;
+    }
+
+    void*
+    allocate(std::size_t size)
+    {
+        auto i    = index(size);
+        auto lock = std::unique_lock{ mutex_ };
+        if (auto* block = free_[i])
+        {
+            free_[i] = block->next;
+            outstanding_++;
+            return block;
+        }
+        lock.unlock();
+
+        auto* p = allocate_block(i);
+        lock.lock();
+        outstanding_++;
+        return p;
+    }
+
+    void
+    deallocate(void* p, std::size_t size) noexcept
+    {
+        auto* block = static_cast<free_block*>(p);
+        auto i      = index(size);
+        auto lock   = std::unique_lock{ mutex_ };
+        block->next = std::exchange(free_[i], block);
+        if (--outstanding_ == 0 && orphaned_)
+        {
+            lock.unlock();
+            delete this;
+        }
+    }
+
+    // adds `n` blocks of `size`, touched by the calling thread
+    void
+    reserve(std::size_t size, std::size_t n)
+    {
+        auto i = index(size);
+        for (std::size_t k = 0; k < n; k++)
+        {
+            auto* p = allocate_block(i);
+            std::memset(p, 0, (i + 1) * line);
+            auto* block = static_cast<free_block*>(p);
+            auto lock   = std::lock_guard{ mutex_ };
+            block->next = std::exchange(free_[i], block);
+        }
+    }
+
+    // called by the service of the context when it is destroyed
+    void
+    orphan() noexcept
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        orphaned_ = true;
+        if (outstanding_ == 0)
+        {
+            lock.unlock();
+            delete this;
+        }
+    }
+};
+
+class context_pool_service : public net::execution_context::service
+{
+    context_pool* pool_{ new context_pool{} };
+
+    void
+    shutdown() override
+    {
+    }
+
+  public:
+    static inline net::execution_context::id id;
+
+    explicit context_pool_service(net::execution_context& ctx)
+        : net::execution_context::service{ ctx }
+    {
+    }
+
+    ~context_pool_service()
+    {
+        pool_->orphan();
+    }
+
+    context_pool*
+    pool() const noexcept
+    {
+        return pool_;
+    }
+};
+} // namespace detail
+
+// Allocator serving single objects from per-thread, size-class free lists.
+template<typename T>
+class pooled_allocator
+{
+    template<typename U>
+    using pool_type = detail::block_pool<
+        (std::max(sizeof(U), sizeof(detail::free_block)) + 15) / 16 * 16,
+        std::max(alignof(U), alignof(detail::free_block))>;
+
+  public:
+    using value_type = T;
+
+    pooled_allocator() noexcept = default;
+
+    template<typename U>
+    pooled_allocator(const pooled_allocator<U>&) noexcept
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        if (n != 1)
+            return std::allocator<T>{}.allocate(n);
+
+        return static_cast<T*>(pool_type<T>::allocate());
+    }
+
+    void
+    deallocate(T* p, std::size_t n) noexcept
+    {
+        if (n != 1)
+            return std::allocator<T>{}.deallocate(p, n);
+
+        pool_type<T>::deallocate(p);
+    }
+
+    friend bool
+    operator==(const pooled_allocator&, const pooled_allocator&) noexcept
+    {
+        return true;
+    }
+
+    friend bool
+    operator!=(const pooled_allocator&, const pooled_allocator&) noexcept
+    {
+        return false;
+    }
+};
+
+// Allocator serving single objects from a pool kept for the execution context
+// of an executor, typically the receiver's, so that shared states created on
+// other threads (or NUMA nodes) are placed near the threads that wait on them
+// once the pool has been filled from there with reserve_states(). It must not
+// allocate once the context is destroyed.
+template<typename T>
+class context_allocator
+{
+    template<typename>
+    friend class context_allocator;
+
+    detail::context_pool* pool_;
+
+  public:
+    using value_type = T;
+
+    template<typename Executor>
+        requires requires(const Executor& exec) {
+            net::query(exec, net::execution::context);
+        }
+    explicit context_allocator(const Executor& exec)
+        : pool_{ net::use_service<detail::context_pool_service>(
+                     net::query(exec, net::execution::context))
+                     .pool() }
+    {
+    }
+
+    template<typename U>
+    context_allocator(const context_allocator<U>& other) noexcept
+        : pool_{ other.pool_ }
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        if (n != 1 || !detail::context_pool::fits(sizeof(T), alignof(T)))
+            return std::allocator<T>{}.allocate(n);
+
+        return static_cast<T*>(pool_->allocate(sizeof(T)));
+    }
+
+    void
+    deallocate(T* p, std::size_t n) noexcept
+    {
+        if (n != 1 || !detail::context_pool::fits(sizeof(T), alignof(T)))
+            return std::allocator<T>{}.deallocate(p, n);
+
+        pool_->deallocate(p, sizeof(T));
+    }
+
+    // Adds `n` blocks for the shared states that create<T>() makes with this
+    // allocator, touched by the calling thread. Called from a thread of the
+    // context, this places them on its NUMA node.
+    void
+    reserve_states(std::size_t n) const
+    {
+        using block_type =
+            detail::shared_state_block<T, thread_safe, context_allocator>;
+
+        if constexpr (detail::context_pool::fits(
+                          sizeof(block_type), alignof(block_type)))
+            pool_->reserve(sizeof(block_type), n);
+    }
+
+    friend bool
+    operator==(const context_allocator& a, const context_allocator& b) noexcept
+    {
+        return a.pool_ == b.pool_;
+    }
+
+    friend bool
+    operator!=(const context_allocator& a, const context_allocator& b) noexcept
+    {
+        return a.pool_ != b.pool_;
+    }
+};
+
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<sender<T>, receiver<T>>
+create(Allocator alloc = {})
+{
+    auto* p = detail::allocate_shared_state<T, thread_safe>(alloc);
+    return { p, p };
+}
+
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<sender<T>, receiver<T>>
+create(padded_t, Allocator alloc = {})
+{
+    auto* p = detail::
+        allocate_shared_state<T, thread_safe, Allocator, ONESHOT_CACHE_LINE_SIZE>(
+            alloc);
+    return { p, p };
+}
+
+// Creates n pairs whose shared states are laid out in a single allocation.
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<std::vector<sender<T>>, std::vector<receiver<T>>>
+create_n(std::size_t n, Allocator alloc = {})
+{
+    return detail::create_n<T, thread_safe>(n, alloc);
+}
+
+// As above, with each shared state on its own cache line.
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<std::vector<sender<T>>, std::vector<receiver<T>>>
+create_n(std::size_t n, padded_t, Allocator alloc = {})
+{
+    return detail::create_n<T, thread_safe, ONESHOT_CACHE_LINE_SIZE>(n, alloc);
+}
+
+// Allocates the shared state from `resource`, and the wait operations that
+// don't fit next to it unless their handler has an allocator of its own.
+template<typename T, typename Resource>
+    requires std::is_base_of_v<std::pmr::memory_resource, Resource>
+inline std::pair<sender<T>, receiver<T>>
+create(Resource* resource)
+{
+    return create<T>(std::pmr::polymorphic_allocator<>{ resource });
+}
+
+template<typename T, typename Resource>
+    requires std::is_base_of_v<std::pmr::memory_resource, Resource>
+inline std::pair<std::vector<sender<T>>, std::vector<receiver<T>>>
+create_n(std::size_t n, Resource* resource)
+{
+    return create_n<T>(n, std::pmr::polymorphic_allocator<>{ resource });
+}
+
+template<typename T>
+inline std::pair<sender<T>, receiver<T>>
+pooled_create()
+{
+    return create<T>(pooled_allocator<T>{});
+}
+
+// Creates a sender whose value is shared by all copies of the receiver.
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<broadcast_sender<T>, shared_receiver<T>>
+create_broadcast(Allocator alloc = {})
+{
+    auto* p = detail::allocate_broadcast_state<T, thread_safe>(alloc);
+    return { p, p };
+}
+
+namespace detail
+{
+template<typename Policy, typename Allocator>
+std::pair<latch_sender<Policy>, receiver<std::size_t, Policy>>
+create_latch(Allocator alloc)
+{
+    using block_type = shared_state_block<
+        std::size_t,
+        Policy,
+        Allocator,
+        1,
+        latch_counters<Policy>>;
+
+    auto* p     = block_type::allocate(alloc);
+    p->sender_  = sender_shs_handle<std::size_t, Policy>{ p };
+    auto* extra = static_cast<latch_counters<Policy>*>(p);
+    return { latch_sender<Policy>{ extra }, receiver<std::size_t, Policy>{ p } };
+}
+} // namespace detail
+
+// Creates a latch in a single allocation: copy the sender once per
+// participant, the receiver completes after the last one is done.
+template<typename Allocator = std::allocator<std::size_t>>
+inline std::pair<latch_sender<>, receiver<std::size_t>>
+create_latch(Allocator alloc = {})
+{
+    return detail::create_latch<thread_safe>(alloc);
+}
+
+// A bounded ring of N shared states handed out in order and consumed in the
+// same order, for pipelined replies that complete out of order. The slots
+// are padded and live in a single allocation, a consumed slot is reset and
+// handed out again without allocating. The ring itself belongs to a single
+// thread, the senders it hands out can be sent from anywhere.
+template<typename T, std::size_t N, typename Policy = thread_safe>
+class ordered_ring
+{
+    static_assert(N > 0, "An empty ring can't hand out any slot");
+
+    std::array<receiver<T, Policy>, N> receivers_;
+    std::array<sender<T, Policy>, N> senders_;
+    std::size_t head_{ 0 };
+    std::size_t size_{ 0 };
+
+  public:
+    template<typename Allocator = std::allocator<T>>
+    explicit ordered_ring(Allocator alloc = {})
+    {
+        auto [ss, rs] =
+            detail::create_n<T, Policy, ONESHOT_CACHE_LINE_SIZE>(N, alloc);
+        std::move(ss.begin(), ss.end(), senders_.begin());
+        std::move(rs.begin(), rs.end(), receivers_.begin());
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+
+    bool
+    empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    bool
+    full() const noexcept
+    {
+        return size_ == N;
+    }
+
+    // Hands out the sender of the next slot, nothing if the ring is full.
+    std::optional<sender<T, Policy>>
+    try_push() noexcept
+    {
+        if (full())
+            return std::nullopt;
+
+        return std::move(senders_[(head_ + size_++) % N]);
+    }
+
+    // The receiver of the oldest slot that hasn't been popped.
+    receiver<T, Policy>&
+    front()
+    {
+        if (empty())
+            throw error{ errc::no_state };
+
+        return receivers_[head_];
+    }
+
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait_front(CompletionToken&& token = CompletionToken{})
+    {
+        return front().async_wait(std::forward<CompletionToken>(token));
+    }
+
+    // Recycles the oldest slot once its value has been sent or its sender is
+    // broken, a wait on it must have completed.
+    void
+    pop()
+    {
+        senders_[head_] = front().reset();
+        head_           = (head_ + 1) % N;
+        size_--;
+    }
+};
+
+namespace detail
+{
+// N value slots filled by N senders and a single waiter, in one allocation:
+// the state is followed by the readiness bitmap and the contiguous slots.
+// `word_` counts the settled slots (sent or broken) above a waiting bit, the
+// sender settling the slot that reaches the waiter's target completes it.
+template<typename T>
+class bulk_state
+{
+    static constexpr auto bits = std::size_t{ 64 };
+
+    using bitmap_word = std::atomic<std::uint64_t>;
+
+    std::size_t size_;
+    std::atomic<std::size_t> refs_{ 1 };
+    std::atomic<std::uint64_t> word_{ 0 };
+    std::size_t target_{ 0 };
+    wait_op* wait_op_{ nullptr };
+    void (*deallocate_)(bulk_state*) noexcept;
+
+    static constexpr std::size_t
+    bitmap_offset() noexcept
+    {
+        return (sizeof(bulk_state) + alignof(bitmap_word) - 1) &
+            ~(alignof(bitmap_word) - 1);
+    }
+
+    static constexpr std::size_t
+    slots_offset(std::size_t n) noexcept
+    {
+        auto end = bitmap_offset() + (n + bits - 1) / bits * sizeof(bitmap_word);
+        return (end + alignof(T) - 1) & ~(alignof(T) - 1);
+    }
+
+    bitmap_word*
+    bitmap() const noexcept
+    {
+        return reinterpret_cast<bitmap_word*>(
+            reinterpret_cast<std::uintptr_t>(this) + bitmap_offset());
+    }
+
+    T*
+    slots() const noexcept
+    {
+        return reinterpret_cast<T*>(
+            reinterpret_cast<std::uintptr_t>(this) + slots_offset(size_));
+    }
+
+    // takes the waiter if the waiting bit is still set in `word`
+    bool
+    claim(std::uint64_t word) noexcept
+    {
+        while (word & 1)
+            if (word_.compare_exchange_weak(
+                    word,
+                    word & ~std::uint64_t{ 1 },
+                    std::memory_order_acquire,
+                    std::memory_order_relaxed))
+                return true;
+
+        return false;
+    }
+
+    // slot `index` has been sent or its sender destroyed
+    void
+    settle() noexcept
+    {
+        auto prev = word_.fetch_add(2, std::memory_order_acq_rel);
+        if ((prev & 1) && (prev >> 1) + 1 >= target_ && claim(prev + 2))
+            wait_op_->complete({});
+    }
+
+  public:
+    // the layout of a state with `n` slots
+    static constexpr std::size_t
+    allocation_size(std::size_t n) noexcept
+    {
+        return slots_offset(n) + n * sizeof(T);
+    }
+
+    static constexpr std::size_t alignment =
+        std::max({ alignof(bulk_state), alignof(bitmap_word), alignof(T) });
+
+    bulk_state(std::size_t n, void (*deallocate)(bulk_state*) noexcept) noexcept
+        : size_{ n }
+        , deallocate_{ deallocate }
+    {
+        std::uninitialized_value_construct_n(
+            bitmap(), (n + bits - 1) / bits);
+    }
+
+    bulk_state(const bulk_state&) = delete;
+
+    void
+    add_ref() noexcept
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        for_each_ready([](std::size_t, T& value) { std::destroy_at(&value); });
+        deallocate_(this);
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+
+    std::size_t
+    settled() const noexcept
+    {
+        return word_.load(std::memory_order_acquire) >> 1;
+    }
+
+    template<typename... Args>
+    void
+    send(std::size_t index, Args&&... args)
+    {
+        new (slots() + index) T(std::forward<Args>(args)...);
+        bitmap()[index / bits].fetch_or(
+            std::uint64_t{ 1 } << (index % bits), std::memory_order_release);
+        settle();
+    }
+
+    void
+    sender_detached() noexcept
+    {
+        settle();
+    }
+
+    T*
+    get(std::size_t index) const noexcept
+    {
+        auto word = bitmap()[index / bits].load(std::memory_order_acquire);
+        if (word & (std::uint64_t{ 1 } << (index % bits)))
+            return std::launder(slots() + index);
+
+        return nullptr;
+    }
+
+    // calls `f(index, value)` for each slot holding a value, in index order
+    template<typename F>
+    void
+    for_each_ready(F&& f) const
+    {
+        for (auto i = std::size_t{ 0 }; i * bits < size_; i++)
+        {
+            auto word = bitmap()[i].load(std::memory_order_acquire);
+            while (word)
+            {
+                auto index = i * bits + std::countr_zero(word);
+                f(index, *std::launder(slots() + index));
+                word &= word - 1;
+            }
+        }
+    }
+
+    T*
+    data() const noexcept
+    {
+        return std::launder(slots());
+    }
+
+    // completes once `count` slots have settled
+    template<typename CompletionToken>
+    auto
+    async_wait(
+        completion_mode mode,
+        std::size_t count,
+        CompletionToken&& token);
+};
+
+// Keeps a bulk state alive until the wait on it has completed.
+template<typename T>
+struct bulk_result
+{
+    bulk_state<T>* state;
+
+    bulk_result(bulk_state<T>* s) noexcept
+        : state{ s }
+    {
+        state->add_ref();
+    }
+
+    bulk_result(bulk_result&& other) noexcept
+        : state{ std::exchange(other.state, nullptr) }
+    {
+    }
+
+    ~bulk_result()
+    {
+        if (state)
+            state->release();
+    }
+
+    template<typename Handler>
+    void
+    operator()(Handler&& handler, error_code ec) &&
+    {
+        std::exchange(state, nullptr)->release();
+        std::move(handler)(ec);
+    }
+};
+
 template<typename T>
-class sender
+template<typename CompletionToken>
+auto
+bulk_state<T>::async_wait(
+    completion_mode mode,
+    std::size_t count,
+    CompletionToken&& token)
+{
+    return net::async_initiate<decltype(token), void(error_code)>(
+        [this, mode, count](auto handler)
+        {
+            auto exec = net::get_associated_executor(handler);
+
+            using model_type = wait_op_model<
+                decltype(exec),
+                std::decay_t<decltype(handler)>,
+                bulk_result<T>>;
+
+            auto* model = model_type::construct(
+                std::move(exec), std::move(handler), mode, { this });
+
+            auto c_slot = model->get_cancellation_slot();
+            if (c_slot.is_connected())
+            {
+                c_slot.assign(
+                    [this, model](net::cancellation_type type)
+                    {
+                        if (type != net::cancellation_type::none &&
+                            claim(word_.load(std::memory_order_relaxed)))
+                        {
+                            trace(trace_event::cancel, this);
+                            model->complete_deferred(errc::cancelled);
+                        }
+                    });
+            }
+
+            auto word = word_.load(std::memory_order_acquire);
+            if (word & 1)
+                return model->complete_immediately(
+                    errc::duplicate_wait_on_receiver);
+
+            trace(trace_event::wait, this);
+            wait_op_ = model;
+            target_  = count;
+            do
+            {
+                if ((word >> 1) >= count)
+                    return model->complete_immediately({});
+            } while (!word_.compare_exchange_weak(
+                word,
+                word | 1,
+                std::memory_order_release,
+                std::memory_order_acquire));
+        },
+        token);
+}
+
+template<typename T, typename Allocator>
+bulk_state<T>*
+allocate_bulk_state(std::size_t n, Allocator alloc)
+{
+    using state_type = bulk_state<T>;
+
+    constexpr auto align = std::max(state_type::alignment, alignof(Allocator));
+
+    struct alignas(align) unit
+    {
+        unsigned char bytes[align];
+    };
+
+    // the allocator is kept in front of the state
+    constexpr auto header =
+        (sizeof(Allocator) + alignof(unit) - 1) / alignof(unit) * sizeof(unit);
+
+    using r_alloc_t =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<unit>;
+    using traits_t = std::allocator_traits<r_alloc_t>;
+
+    struct block
+    {
+        static std::size_t
+        units(std::size_t n) noexcept
+        {
+            return (header + state_type::allocation_size(n) + sizeof(unit) - 1) /
+                sizeof(unit);
+        }
+
+        static void
+        deallocate(state_type* p) noexcept
+        {
+            auto* mem = reinterpret_cast<unsigned char*>(p) - header;
+            auto* a   = std::launder(reinterpret_cast<Allocator*>(mem));
+            auto r_alloc = r_alloc_t{ std::move(*a) };
+            auto count   = units(p->size());
+            std::destroy_at(a);
+            std::destroy_at(p);
+            traits_t::deallocate(r_alloc, reinterpret_cast<unit*>(mem), count);
+        }
+    };
+
+    auto r_alloc = r_alloc_t{ alloc };
+    auto* mem =
+        reinterpret_cast<unsigned char*>(traits_t::allocate(r_alloc, block::units(n)));
+    new (mem) Allocator(alloc); // noexcept
+    auto* p = new (mem + header) state_type{ n, &block::deallocate };
+    trace(trace_event::create, p);
+    return p;
+}
+} // namespace detail
+
+// Fills one slot of a bulk, a sender destroyed without sending settles its
+// slot without a value.
+template<typename T>
+class bulk_sender
 {
-    detail::sender_shs_handle<T> shs_handle_;
+    detail::bulk_state<T>* state_{ nullptr };
+    std::size_t index_{ 0 };
 
   public:
-    sender() noexcept = default;
+    bulk_sender() noexcept = default;
 
-    sender(detail::shared_state<T>* shared_state) noexcept
-        : shs_handle_{ shared_state }
+    bulk_sender(detail::bulk_state<T>* state, std::size_t index) noexcept
+        : state_{ state }
+        , index_{ index }
+    {
+    }
+
+    bulk_sender(bulk_sender&& other) noexcept
+        : state_{ std::exchange(other.state_, nullptr) }
+        , index_{ other.index_ }
+    {
+    }
+
+    bulk_sender&
+    operator=(bulk_sender&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+        std::swap(index_, other.index_);
+        return *this;
+    }
+
+    ~bulk_sender()
+    {
+        if (state_)
+        {
+            state_->sender_detached();
+            state_->release();
+        }
+    }
+
+    std::size_t
+    index() const noexcept
     {
+        return index_;
     }
 
     template<typename... Args>
     void
     send(Args&&... args)
     {
-        if (!shs_handle_)
+        if (!state_)
             throw error{ errc::no_state };
 
-        shs_handle_->send(std::forward<Args>(args)...);
-        shs_handle_.release();
+        state_->send(index_, std::forward<Args>(args)...);
+        std::exchange(state_, nullptr)->release();
     }
 };
 
+// Receiving side of a bulk: N slots sharing one allocation and one waiter,
+// the memory-dense counterpart of async_wait_all for a fixed fan-out. Slots
+// are read in place and, once all of them hold values, as a contiguous span.
 template<typename T>
-class receiver
+class bulk_receiver
 {
-    detail::receiver_shs_handle<T> shs_handle_;
+    detail::bulk_state<T>* state_{ nullptr };
+
+    detail::bulk_state<T>*
+    state() const
+    {
+        if (!state_)
+            throw error{ errc::no_state };
+
+        return state_;
+    }
 
   public:
-    receiver() noexcept = default;
+    bulk_receiver() noexcept = default;
 
-    receiver(detail::shared_state<T>* shared_state) noexcept
-        : shs_handle_{ shared_state }
+    bulk_receiver(detail::bulk_state<T>* state) noexcept
+        : state_{ state }
     {
     }
 
-    template<typename CompletionToken = net::deferred_t>
-    auto
-    async_extract(CompletionToken&& token = CompletionToken{}) &&
+    bulk_receiver(bulk_receiver&& other) noexcept
+        : state_{ std::exchange(other.state_, nullptr) }
     {
-        if (!shs_handle_)
-            throw error{ errc::no_state };
-
-        return net::async_compose<
-            CompletionToken,
-            detail::async_extract_signature_t<T>>(
-            [shs_handle = std::move(shs_handle_),
-             init       = false](auto&& self, error_code ec = {}) mutable
-            {
-                if (!std::exchange(init, true))
-                    return shs_handle->async_wait(std::move(self));
+    }
 
-                if (ec)
-                {
-                    if constexpr (std::is_same_v<T, void>)
-                        return self.complete(ec);
-                    else
-                        return self.complete(ec, T{});
-                }
+    bulk_receiver&
+    operator=(bulk_receiver&& other) noexcept
+    {
+        std::swap(state_, other.state_);
+        return *this;
+    }
 
-                if constexpr (std::is_same_v<T, void>)
-                {
-                    return self.complete(ec);
-                }
-                else
-                {
-                    if (auto* p = shs_handle->get_stored_object())
-                        return self.complete(ec, std::move(*p));
-                    else
-                        return self.complete(errc::unready, T{});
-                }
-            },
-            token);
+    ~bulk_receiver()
+    {
+        if (state_)
+            state_->release();
     }
 
-    template<typename CompletionToken = net::deferred_t>
-    auto
-    async_wait(CompletionToken&& token = CompletionToken{})
+    std::size_t
+    size() const
     {
-        if (!shs_handle_)
-            throw error{ errc::no_state };
+        return state()->size();
+    }
 
-        return shs_handle_->async_wait(std::forward<CompletionToken>(token));
+    // the number of slots that have been sent or whose sender is broken
+    std::size_t
+    settled() const
+    {
+        return state()->settled();
     }
 
     bool
-    is_ready() const
+    is_ready(std::size_t index) const
     {
-        if (!shs_handle_)
-            throw error{ errc::no_state };
+        return state()->get(index) != nullptr;
+    }
 
-        return shs_handle_->is_ready();
+    T&
+    get(std::size_t index) const
+    {
+        if (auto* p = state()->get(index))
+            return *p;
+
+        throw error{ errc::unready };
     }
 
-    decltype(auto)
-    get() const
+    // Calls `f(index, value)` for each slot holding a value.
+    template<typename F>
+    void
+    for_each_ready(F&& f) const
     {
-        static_assert(!std::is_same_v<T, void>, "Only for non void receivers");
+        state()->for_each_ready(std::forward<F>(f));
+    }
 
-        if (!shs_handle_)
-            throw error{ errc::no_state };
+    // All the values, throws unless every slot holds one.
+    std::span<T>
+    values() const
+    {
+        auto* s    = state();
+        auto count = std::size_t{ 0 };
+        s->for_each_ready([&](std::size_t, T&) { count++; });
+        if (count != s->size())
+            throw error{ errc::unready };
 
-        if (auto* p = shs_handle_->get_stored_object())
-            return std::add_lvalue_reference_t<T>(*p);
+        return { s->data(), s->size() };
+    }
 
-        throw error{ errc::unready };
+    // Completes once every slot has been sent or its sender is broken.
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait(CompletionToken&& token = CompletionToken{}) const
+    {
+        return state()->async_wait(
+            completion_mode::post,
+            state()->size(),
+            std::forward<CompletionToken>(token));
+    }
+
+    // Completes once at least `count` slots have settled, the next ready slot
+    // is awaited with `settled() + 1`. A single wait can be pending.
+    template<typename CompletionToken = net::deferred_t>
+    auto
+    async_wait_settled(
+        std::size_t count,
+        CompletionToken&& token = CompletionToken{}) const
+    {
+        return state()->async_wait(
+            completion_mode::post,
+            std::min(count, state()->size()),
+            std::forward<CompletionToken>(token));
     }
 };
 
+// Creates a bulk of `n` slots, the sender of slot i is at index i.
 template<typename T, typename Allocator = std::allocator<T>>
-inline std::pair<sender<T>, receiver<T>>
-create(Allocator alloc = {})
+std::pair<std::vector<bulk_sender<T>>, bulk_receiver<T>>
+create_bulk(std::size_t n, Allocator alloc = {})
 {
-    struct wrapper
+    static_assert(!std::is_same_v<T, void>, "Bulk slots hold values");
+
+    auto* state = detail::allocate_bulk_state<T>(n, alloc);
+    auto r      = bulk_receiver<T>{ state };
+    auto ss     = std::vector<bulk_sender<T>>{};
+    ss.reserve(n);
+    for (auto i = std::size_t{ 0 }; i < n; i++)
     {
-        detail::shared_state<T> shared_state_;
-        [[no_unique_address]] Allocator alloc_;
+        state->add_ref();
+        ss.emplace_back(state, i);
+    }
+    return { std::move(ss), std::move(r) };
+}
 
-        wrapper(void (*deleter)(detail::shared_state<T>*), Allocator alloc)
-            : shared_state_{ deleter }
-            , alloc_{ alloc }
+#ifdef ONESHOT_HAS_EVENTFD
+namespace detail
+{
+// The eventfd of a readiness_notifier and the notifications it hasn't
+// consumed yet, in a lock-free stack. The notifier and every pending watch
+// hold a reference, so a watch completing after the notifier is gone still
+// has an eventfd to write to.
+class notifier_core
+{
+  public:
+    struct watch_op final : wait_op
+    {
+        notifier_core* core_;
+        std::uint64_t tag_;
+        watch_op* next_{ nullptr };
+
+        watch_op(notifier_core* core, std::uint64_t tag) noexcept
+            : wait_op{ &wait_op::func<watch_op> }
+            , core_{ core }
+            , tag_{ tag }
+        {
+        }
+
+        void
+        shutdown() noexcept
+        {
+            auto* core = core_;
+            delete this;
+            core->release();
+        }
+
+        void
+        complete(error_code) noexcept
+        {
+            core_->push(this);
+        }
+
+        void
+        complete_deferred(error_code) noexcept
+        {
+            core_->push(this);
+        }
+
+        void
+        complete_immediately(error_code) noexcept
         {
+            core_->push(this);
         }
     };
 
-    using r_alloc_t = typename std::allocator_traits<
-        Allocator>::template rebind_alloc<wrapper>;
-    using traits_t = std::allocator_traits<r_alloc_t>;
-    auto r_alloc   = r_alloc_t{ alloc };
-    auto* p        = traits_t::allocate(r_alloc, 1);
-    auto* deleter  = +[](detail::shared_state<T>* shared_state)
+  private:
+    int fd_;
+    std::atomic<std::size_t> refs_{ 1 };
+    std::atomic<watch_op*> head_{ nullptr };
+
+    ~notifier_core()
     {
-        auto* p      = reinterpret_cast<wrapper*>(shared_state);
-        auto r_alloc = r_alloc_t{ p->alloc_ }; // copy before destroy
-        traits_t::destroy(r_alloc, p);
-        traits_t::deallocate(r_alloc, p, 1);
-    };
-    traits_t::construct(r_alloc, p, deleter, alloc); // noexcept
-    return { &p->shared_state_, &p->shared_state_ };
+        ::close(fd_);
+    }
+
+    static void
+    drop(watch_op* op) noexcept
+    {
+        while (op)
+            delete std::exchange(op, op->next_);
+    }
+
+  public:
+    notifier_core()
+        : fd_{ ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) }
+    {
+        if (fd_ < 0)
+            throw std::system_error{ errno, std::system_category() };
+    }
+
+    int
+    native_handle() const noexcept
+    {
+        return fd_;
+    }
+
+    void
+    acquire() noexcept
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void
+    release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        drop(head_.exchange(nullptr, std::memory_order_acquire));
+        delete this;
+    }
+
+    // the reference of `op` is handed over to the stack
+    void
+    push(watch_op* op) noexcept
+    {
+        auto* head = head_.load(std::memory_order_relaxed);
+        do
+            op->next_ = head;
+        while (!head_.compare_exchange_weak(
+            head, op, std::memory_order_release, std::memory_order_relaxed));
+
+        // the consumer reads the eventfd before taking the stack, so only
+        // the notification that finds it empty has to write
+        if (!head)
+        {
+            auto one = std::uint64_t{ 1 };
+            [[maybe_unused]] auto n = ::write(fd_, &one, sizeof(one));
+        }
+        release();
+    }
+
+    template<typename F>
+    std::size_t
+    consume(F&& f)
+    {
+        auto count              = std::uint64_t{};
+        [[maybe_unused]] auto n = ::read(fd_, &count, sizeof(count));
+
+        // reversed into the order of the notifications
+        auto* list = static_cast<watch_op*>(nullptr);
+        auto* op   = head_.exchange(nullptr, std::memory_order_acquire);
+        while (op)
+            std::exchange(op, op->next_)->next_ = std::exchange(list, op);
+
+        auto consumed = std::size_t{ 0 };
+        try
+        {
+            while (list)
+            {
+                auto tag = list->tag_;
+                delete std::exchange(list, list->next_);
+                consumed++;
+                f(tag);
+            }
+        }
+        catch (...)
+        {
+            drop(list);
+            throw;
+        }
+        return consumed;
+    }
+};
+} // namespace detail
+
+// Makes receivers observable from event loops other than Asio's: the eventfd
+// returned by native_handle() becomes readable once a watched receiver is
+// ready or its sender is broken, and consume() reports the tags of those
+// receivers. A single notifier covers any number of receivers. Watching can
+// happen from any thread, consuming belongs to a single one.
+class readiness_notifier
+{
+    detail::notifier_core* core_;
+
+  public:
+    readiness_notifier()
+        : core_{ new detail::notifier_core{} }
+    {
+    }
+
+    readiness_notifier(const readiness_notifier&) = delete;
+    readiness_notifier&
+    operator=(const readiness_notifier&) = delete;
+
+    ~readiness_notifier()
+    {
+        core_->release();
+    }
+
+    // Stays open until pending watches complete, even past the notifier.
+    int
+    native_handle() const noexcept
+    {
+        return core_->native_handle();
+    }
+
+    // Notifies `tag` once `r` is ready, this takes the place of a wait on
+    // the receiver, which must outlive the notification.
+    template<typename T, typename Policy>
+    void
+    watch(receiver<T, Policy>& r, std::uint64_t tag)
+    {
+        using op_type = detail::notifier_core::watch_op;
+
+        auto* state = detail::receiver_access::state(r);
+        auto* op    = new op_type{ core_, tag };
+        core_->acquire();
+
+        auto ec = error_code{};
+        if (!state->start_wait(op, ec))
+        {
+            if (ec == errc::duplicate_wait_on_receiver)
+            {
+                op->shutdown();
+                throw error{ errc::duplicate_wait_on_receiver };
+            }
+            op->complete_immediately(ec);
+        }
+    }
+
+    // Clears the eventfd and calls `f(tag)` for each notification since the
+    // last call, returns their count. A readable eventfd may have nothing to
+    // consume when it raced with a previous call.
+    template<typename F>
+    std::size_t
+    consume(F&& f)
+    {
+        return core_->consume(std::forward<F>(f));
+    }
+};
+#endif
+
+// Sender/receiver pairs confined to a single thread (or strand).
+namespace local
+{
+template<typename T>
+using sender = oneshot::sender<T, single_threaded>;
+
+template<typename T>
+using receiver = oneshot::receiver<T, single_threaded>;
+
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<sender<T>, receiver<T>>
+create(Allocator alloc = {})
+{
+    auto* p = detail::allocate_shared_state<T, single_threaded>(alloc);
+    return { p, p };
+}
+
+template<typename T, typename Allocator = std::allocator<T>>
+inline std::pair<std::vector<sender<T>>, std::vector<receiver<T>>>
+create_n(std::size_t n, Allocator alloc = {})
+{
+    return detail::create_n<T, single_threaded>(n, alloc);
+}
+
+template<typename Allocator = std::allocator<std::size_t>>
+inline std::pair<latch_sender<single_threaded>, receiver<std::size_t>>
+create_latch(Allocator alloc = {})
+{
+    return detail::create_latch<single_threaded>(alloc);
 }
+} // namespace local
 } // namespace oneshot
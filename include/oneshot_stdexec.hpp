@@ -0,0 +1,198 @@
+// Copyright (c) 2022 Mohammad Nejati
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <oneshot.hpp>
+
+#include <stdexec/execution.hpp>
+
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Receivers as P2300 senders, for composition in stdexec pipelines.
+namespace oneshot::exec
+{
+namespace detail
+{
+template<typename T>
+struct value_signature
+{
+    using type = stdexec::set_value_t(T);
+};
+
+template<>
+struct value_signature<void>
+{
+    using type = stdexec::set_value_t();
+};
+
+// The operation state is the wait operation, constructed in the storage given
+// to connect(). It completes inline on the thread that sends the value, or
+// that requests a stop before the value has been sent.
+template<typename T, typename Policy, typename Rcvr>
+class extract_operation final : public oneshot::detail::wait_op
+{
+    using base_type    = oneshot::detail::wait_op;
+    using handle_type  = oneshot::detail::receiver_shs_handle<T, Policy>;
+    using token_type   = stdexec::stop_token_of_t<stdexec::env_of_t<Rcvr>>;
+    static constexpr bool stoppable = !stdexec::unstoppable_token<token_type>;
+
+    struct on_stop
+    {
+        extract_operation* self;
+
+        void
+        operator()() const noexcept
+        {
+            if (self->shs_handle_->cancel_wait(self))
+                self->complete(errc::cancelled);
+        }
+    };
+
+    using callback_type = stdexec::stop_callback_for_t<token_type, on_stop>;
+
+    handle_type shs_handle_;
+    Rcvr rcvr_;
+    error_code ec_;
+    // set by whichever of start() and the completion comes second
+    std::atomic<bool> armed_{ false };
+    std::optional<callback_type> callback_;
+
+    void
+    finish() noexcept
+    {
+        if (ec_ == errc::cancelled)
+            return stdexec::set_stopped(std::move(rcvr_));
+
+        if (ec_)
+            return stdexec::set_error(std::move(rcvr_), ec_);
+
+        if constexpr (std::is_void_v<T>)
+        {
+            stdexec::set_value(std::move(rcvr_));
+        }
+        else
+        {
+            try
+            {
+                stdexec::set_value(
+                    std::move(rcvr_), oneshot::detail::take_value(shs_handle_));
+            }
+            catch (...)
+            {
+                stdexec::set_error(std::move(rcvr_), std::current_exception());
+            }
+        }
+    }
+
+  public:
+    extract_operation(handle_type shs_handle, Rcvr rcvr) noexcept(
+        std::is_nothrow_move_constructible_v<Rcvr>)
+        : base_type{ &base_type::func<extract_operation> }
+        , shs_handle_{ std::move(shs_handle) }
+        , rcvr_(std::move(rcvr))
+    {
+    }
+
+    extract_operation(const extract_operation&) = delete;
+    extract_operation&
+    operator=(const extract_operation&) = delete;
+
+    void
+    start() & noexcept
+    {
+        if (!shs_handle_->start_wait(this, ec_))
+            return finish();
+
+        if constexpr (stoppable)
+        {
+            // the callback runs right away when a stop has been requested
+            callback_.emplace(
+                stdexec::get_stop_token(stdexec::get_env(rcvr_)),
+                on_stop{ this });
+            if (armed_.exchange(true, std::memory_order_acq_rel))
+            {
+                callback_.reset();
+                finish();
+            }
+        }
+    }
+
+    void
+    shutdown() noexcept
+    {
+    }
+
+    void
+    complete(error_code ec) noexcept
+    {
+        trace_.post(this);
+        trace_.invoke(this, ec);
+        ec_ = ec;
+        if constexpr (stoppable)
+        {
+            if (!armed_.exchange(true, std::memory_order_acq_rel))
+                return;
+
+            callback_.reset();
+        }
+        finish();
+    }
+
+    void
+    complete_deferred(error_code ec) noexcept
+    {
+        complete(ec);
+    }
+
+    void
+    complete_immediately(error_code ec) noexcept
+    {
+        complete(ec);
+    }
+};
+} // namespace detail
+
+// A sender completing with the value of a receiver: set_value(T) once it is
+// sent, set_error(error_code) with errc::broken_sender when the sender is
+// destroyed and set_stopped() when a stop is requested first. Connecting
+// doesn't allocate.
+template<typename T, typename Policy = thread_safe>
+class extract_sender
+{
+    oneshot::detail::receiver_shs_handle<T, Policy> shs_handle_;
+
+  public:
+    using sender_concept        = stdexec::sender_t;
+    using completion_signatures = stdexec::completion_signatures<
+        typename detail::value_signature<T>::type,
+        stdexec::set_error_t(error_code),
+        stdexec::set_error_t(std::exception_ptr),
+        stdexec::set_stopped_t()>;
+
+    explicit extract_sender(receiver<T, Policy> r)
+        : shs_handle_{ oneshot::detail::receiver_access::take(r) }
+    {
+    }
+
+    template<stdexec::receiver Rcvr>
+    detail::extract_operation<T, Policy, Rcvr>
+    connect(Rcvr rcvr) &&
+    {
+        return { std::move(shs_handle_), std::move(rcvr) };
+    }
+};
+
+// Gives up `r` for a sender of its value.
+template<typename T, typename Policy>
+extract_sender<T, Policy>
+extract(receiver<T, Policy>&& r)
+{
+    return extract_sender<T, Policy>{ std::move(r) };
+}
+} // namespace oneshot::exec
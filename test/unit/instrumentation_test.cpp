@@ -0,0 +1,124 @@
+// Copyright (c) 2022 Mohammad Nejati
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+namespace test
+{
+struct recorder;
+} // namespace test
+
+#define ONESHOT_INSTRUMENTATION test::recorder
+
+#include <oneshot.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace test
+{
+struct recorder
+{
+    static inline std::vector<oneshot::trace_event> events;
+
+    static void
+    record(const oneshot::trace_record& r) noexcept
+    {
+        events.push_back(r.event);
+        oneshot::latency_recorder::record(r);
+    }
+};
+} // namespace test
+
+BOOST_AUTO_TEST_SUITE(instrumentation)
+
+namespace asio = boost::asio;
+using oneshot::trace_event;
+
+BOOST_AUTO_TEST_CASE(send_and_wait)
+{
+    auto ctx = asio::io_context{};
+    test::recorder::events.clear();
+
+    {
+        auto [s, r] = oneshot::create<int>();
+        r.async_wait(asio::bind_executor(ctx, [](auto) {}));
+        s.send(42);
+        ctx.run();
+    }
+
+    BOOST_CHECK((
+        test::recorder::events ==
+        std::vector{ trace_event::create,
+                     trace_event::wait,
+                     trace_event::send,
+                     trace_event::post,
+                     trace_event::invoke,
+                     trace_event::receiver_detached }));
+}
+
+BOOST_AUTO_TEST_CASE(broken_sender_and_cancellation)
+{
+    auto ctx = asio::io_context{};
+    test::recorder::events.clear();
+
+    auto cs     = asio::cancellation_signal{};
+    auto [s, r] = oneshot::create<int>();
+    r.async_wait(asio::bind_cancellation_slot(
+        cs.slot(), asio::bind_executor(ctx, [](auto) {})));
+    cs.emit(asio::cancellation_type::total);
+    ctx.run();
+    ctx.restart();
+
+    r.async_wait(asio::bind_executor(ctx, [](auto) {}));
+    s = {};
+    ctx.run();
+
+    BOOST_CHECK((
+        test::recorder::events ==
+        std::vector{ trace_event::create,
+                     trace_event::wait,
+                     trace_event::cancel,
+                     trace_event::post,
+                     trace_event::invoke,
+                     trace_event::wait,
+                     trace_event::broken_sender,
+                     trace_event::post,
+                     trace_event::invoke }));
+}
+
+BOOST_AUTO_TEST_CASE(latency_recorder)
+{
+    auto ctx    = asio::io_context{};
+    auto before = oneshot::latency_recorder::collect();
+
+    auto receivers = std::vector<oneshot::receiver<int>>{};
+    for (auto i = 0; i < 10; i++)
+    {
+        auto [s, r] = oneshot::create<int>();
+        r.async_wait(asio::bind_executor(ctx, [](auto) {}));
+        if (i % 2)
+            s.send(i);
+        receivers.push_back(std::move(r));
+    }
+    ctx.run();
+
+    auto after = oneshot::latency_recorder::collect();
+    auto completions = [&](oneshot::errc e)
+    {
+        auto i = static_cast<std::size_t>(e);
+        return after.completions[i] - before.completions[i];
+    };
+
+    BOOST_CHECK_EQUAL(completions(oneshot::errc{}), 5);
+    BOOST_CHECK_EQUAL(completions(oneshot::errc::broken_sender), 5);
+    BOOST_CHECK_EQUAL(
+        after.send_to_wake.count() - before.send_to_wake.count(), 10);
+    BOOST_CHECK_EQUAL(
+        after.post_to_run.count() - before.post_to_run.count(), 10);
+    BOOST_CHECK(
+        after.post_to_run.quantile(0.5) < std::chrono::nanoseconds::max());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,12 +7,143 @@
 #include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <array>
+#include <coroutine>
 #include <memory_resource>
+#include <thread>
+
+#ifdef ONESHOT_HAS_EVENTFD
+#include <poll.h>
+#endif
 
 BOOST_AUTO_TEST_SUITE(oneshot)
 
 namespace asio = boost::asio;
 
+namespace
+{
+template<typename T>
+struct counting_allocator
+{
+    using value_type = T;
+
+    int* count;
+    // allocations not yet deallocated, if given
+    int* outstanding{ nullptr };
+
+    counting_allocator(int* count, int* outstanding = nullptr) noexcept
+        : count{ count }
+        , outstanding{ outstanding }
+    {
+    }
+
+    template<typename U>
+    counting_allocator(const counting_allocator<U>& other) noexcept
+        : count{ other.count }
+        , outstanding{ other.outstanding }
+    {
+    }
+
+    T*
+    allocate(std::size_t n)
+    {
+        ++*count;
+        if (outstanding)
+            ++*outstanding;
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void
+    deallocate(T* p, std::size_t n)
+    {
+        if (outstanding)
+            --*outstanding;
+        std::allocator<T>{}.deallocate(p, n);
+    }
+
+    friend bool
+    operator==(const counting_allocator&, const counting_allocator&) = default;
+};
+
+template<typename F>
+struct counted_handler
+{
+    using allocator_type = counting_allocator<void>;
+
+    int* allocations;
+    [[no_unique_address]] F f;
+    int* outstanding{ nullptr };
+
+    allocator_type
+    get_allocator() const noexcept
+    {
+        return { allocations, outstanding };
+    }
+
+    template<typename... Args>
+    void
+    operator()(Args&&... args)
+    {
+        f(std::forward<Args>(args)...);
+    }
+};
+
+// an eagerly started coroutine that isn't tied to an executor
+struct task
+{
+    struct promise_type
+    {
+        task
+        get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void
+        return_void() noexcept
+        {
+        }
+
+        void
+        unhandled_exception()
+        {
+            throw;
+        }
+    };
+};
+
+// values of these types are packed into the state word
+enum class status : uint16_t
+{
+    ok = 7,
+    failed
+};
+
+using letters = std::array<char, 7>;
+} // namespace
+
+template<>
+struct pack_into_state<status> : std::true_type
+{
+};
+
+template<>
+struct pack_into_state<letters> : std::true_type
+{
+};
+
 BOOST_AUTO_TEST_CASE(no_state)
 {
     auto [s, r] = oneshot::create<std::string>();
@@ -53,6 +184,65 @@ BOOST_AUTO_TEST_CASE(custom_allocator)
             std::pmr::new_delete_resource());
 }
 
+BOOST_AUTO_TEST_CASE(memory_resource)
+{
+    struct counting_resource : std::pmr::memory_resource
+    {
+        int allocations = 0;
+        int outstanding = 0;
+
+        void*
+        do_allocate(std::size_t bytes, std::size_t align) override
+        {
+            allocations++;
+            outstanding++;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+
+        void
+        do_deallocate(void* p, std::size_t bytes, std::size_t align) override
+        {
+            outstanding--;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+
+        bool
+        do_is_equal(const memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    auto resource = counting_resource{};
+    auto ctx      = asio::io_context{};
+    auto called   = 0;
+
+    {
+        auto [s, r] = oneshot::create<std::string>(&resource);
+        BOOST_CHECK_EQUAL(resource.allocations, 1);
+
+        // too large for the storage next to the state
+        r.async_wait(asio::bind_executor(
+            ctx,
+            [&, big = std::array<char, 512>{}](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(big.size(), 512);
+            }));
+        BOOST_CHECK_EQUAL(resource.allocations, 2);
+
+        s.send("Hello");
+        ctx.run();
+        BOOST_CHECK_EQUAL(called, 1);
+        BOOST_CHECK_EQUAL(resource.outstanding, 1);
+    }
+    BOOST_CHECK_EQUAL(resource.outstanding, 0);
+
+    auto [ss, rs] = oneshot::create_n<void>(4, &resource);
+    BOOST_CHECK_EQUAL(resource.allocations, 3);
+}
+
 BOOST_AUTO_TEST_CASE(get)
 {
     auto [s, r] = oneshot::create<std::string>();
@@ -394,4 +584,2155 @@ BOOST_AUTO_TEST_CASE(async_extract_cancellation_before_send_void)
     BOOST_CHECK_EQUAL(called, 1);
 }
 
+BOOST_AUTO_TEST_CASE(local_send_value)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::local::create<std::string>();
+    auto called = 0;
+
+    static_assert(std::is_same_v<
+                  decltype(r),
+                  oneshot::receiver<std::string, oneshot::single_threaded>>);
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(r.get(), "Hello");
+            }));
+
+    s.send("Hello");
+
+    BOOST_CHECK_EQUAL(called, 0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(local_async_extract_broken_sender)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::local::create<std::string>();
+    auto called = 0;
+
+    std::move(r).async_extract(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec, auto)
+            {
+                called++;
+                BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+            }));
+
+    {
+        auto s2 = std::move(s);
+    }
+
+    BOOST_CHECK_EQUAL(called, 0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_within_executor)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    r.async_wait(
+        oneshot::completion_mode::dispatch,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(r.get(), "Hello");
+            }));
+
+    asio::post(
+        ctx,
+        [&, s = std::move(s)]() mutable
+        {
+            s.send("Hello");
+            BOOST_CHECK_EQUAL(called, 1);
+        });
+
+    BOOST_CHECK_EQUAL(called, 0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_outside_executor)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<void>();
+    auto called = 0;
+
+    std::move(r).async_extract(
+        oneshot::completion_mode::dispatch,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    s.send();
+
+    BOOST_CHECK_EQUAL(called, 0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(dispatch_wait_after_send)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    s.send("Hello");
+
+    asio::post(
+        ctx,
+        [&]
+        {
+            r.async_wait(
+                oneshot::completion_mode::dispatch,
+                asio::bind_executor(
+                    ctx,
+                    [&](auto ec)
+                    {
+                        called++;
+                        BOOST_CHECK(!ec);
+                    }));
+            // completions from within the initiating function are never
+            // dispatched inline
+            BOOST_CHECK_EQUAL(called, 0);
+        });
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_create_send_value)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::pooled_create<std::string>();
+    auto called = 0;
+
+    static_assert(std::is_same_v<decltype(r), oneshot::receiver<std::string>>);
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(r.get(), "Hello");
+            }));
+
+    s.send("Hello");
+
+    BOOST_CHECK_EQUAL(called, 0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(pooled_allocator_recycles)
+{
+    auto alloc = oneshot::pooled_allocator<std::string>{};
+    auto* p1   = alloc.allocate(1);
+    alloc.deallocate(p1, 1);
+    auto* p2 = alloc.allocate(1);
+    BOOST_CHECK_EQUAL(p1, p2);
+    alloc.deallocate(p2, 1);
+}
+
+BOOST_AUTO_TEST_CASE(context_allocator_recycles)
+{
+    auto ctx1  = asio::io_context{};
+    auto ctx2  = asio::io_context{};
+    auto alloc =
+        oneshot::context_allocator<std::string>{ ctx1.get_executor() };
+    auto* p1   = alloc.allocate(1);
+    alloc.deallocate(p1, 1);
+    auto* p2 = alloc.allocate(1);
+    BOOST_CHECK_EQUAL(p1, p2);
+    alloc.deallocate(p2, 1);
+
+    BOOST_CHECK(
+        alloc == oneshot::context_allocator<std::string>{ ctx1.get_executor() });
+    BOOST_CHECK(
+        alloc != oneshot::context_allocator<std::string>{ ctx2.get_executor() });
+}
+
+BOOST_AUTO_TEST_CASE(context_allocator_outlives_context)
+{
+    auto pairs = std::vector<std::pair<
+        oneshot::sender<std::string>,
+        oneshot::receiver<std::string>>>{};
+    auto called = 0;
+    {
+        auto ctx   = asio::io_context{};
+        auto alloc =
+            oneshot::context_allocator<std::string>{ ctx.get_executor() };
+        alloc.reserve_states(4);
+
+        auto t = std::thread{ [&]
+                              {
+                                  for (auto i = 0; i < 8; i++)
+                                      pairs.push_back(
+                                          oneshot::create<std::string>(alloc));
+                              } };
+        t.join();
+
+        for (auto& [s, r] : pairs)
+        {
+            r.async_wait(asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                }));
+            s.send("value");
+        }
+        ctx.run();
+    }
+    BOOST_CHECK_EQUAL(called, 8);
+    BOOST_CHECK_EQUAL(pairs[7].second.get(), "value");
+    pairs.clear();
+}
+
+BOOST_AUTO_TEST_CASE(pooled_create_cross_thread_release)
+{
+    auto pairs = std::vector<
+        std::pair<oneshot::sender<int>, oneshot::receiver<int>>>{};
+    for (auto i = 0; i < 1000; i++)
+        pairs.push_back(oneshot::pooled_create<int>());
+
+    // release every state on another thread, the surplus moves to the depot
+    std::thread{ [&]
+                 {
+                     for (auto& [s, r] : pairs)
+                     {
+                         s.send(42);
+                         BOOST_CHECK_EQUAL(r.get(), 42);
+                     }
+                     pairs.clear();
+                 } }
+        .join();
+
+    for (auto i = 0; i < 1000; i++)
+        pairs.push_back(oneshot::pooled_create<int>());
+    pairs.clear();
+}
+
+BOOST_AUTO_TEST_CASE(wait_op_in_place)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto called      = 0;
+    auto allocations = 0;
+
+    r.async_wait(asio::bind_executor(
+        ctx,
+        counted_handler{ &allocations,
+                         [&](auto ec)
+                         {
+                             called++;
+                             BOOST_CHECK(!ec);
+                         } }));
+
+    s.send("Hello");
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(default_block_size)
+{
+    using block = oneshot::detail::
+        shared_state_block<int, oneshot::thread_safe, std::allocator<int>>;
+    auto handler = [p = static_cast<int*>(nullptr)](oneshot::error_code) {};
+    using any_model = oneshot::detail::
+        wait_op_model<asio::any_io_executor, decltype(handler)>;
+    using timed_model = oneshot::detail::wait_op_model<
+        asio::io_context::executor_type,
+        asio::executor_binder<decltype(handler), asio::io_context::executor_type>,
+        oneshot::detail::timed_result<oneshot::detail::wait_result>>;
+
+    static_assert(ONESHOT_WAIT_OP_BUFFER_SIZE == 128);
+    static_assert(sizeof(any_model) <= ONESHOT_WAIT_OP_BUFFER_SIZE);
+    static_assert(sizeof(timed_model) <= ONESHOT_WAIT_OP_BUFFER_SIZE);
+
+    // the 24-byte state and the in-place buffer, on 64-bit platforms
+    if constexpr (sizeof(void*) == 8)
+        BOOST_CHECK_EQUAL(sizeof(block), 192);
+}
+
+BOOST_AUTO_TEST_CASE(async_extract_in_place)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto called      = 0;
+    auto allocations = 0;
+
+    std::move(r).async_extract(asio::bind_executor(
+        ctx,
+        counted_handler{ &allocations,
+                         [&](auto ec, std::string v)
+                         {
+                             called++;
+                             BOOST_CHECK(!ec);
+                             BOOST_CHECK_EQUAL(v, "Hello");
+                         } }));
+
+    s.send("Hello");
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(async_extract_not_default_constructible)
+{
+    struct value
+    {
+        explicit value(int v)
+            : v{ v }
+        {
+        }
+
+        int v;
+    };
+
+    auto ctx    = asio::io_context{};
+    auto called = 0;
+
+    auto [s, r] = oneshot::create<value>();
+    std::move(r).async_extract(asio::bind_executor(
+        ctx,
+        [&](auto ec, std::optional<value> v)
+        {
+            called++;
+            BOOST_CHECK(!ec);
+            BOOST_REQUIRE(v);
+            BOOST_CHECK_EQUAL(v->v, 42);
+        }));
+    s.send(42);
+
+    auto [s2, r2] = oneshot::create<value>();
+    std::move(r2).async_extract(asio::bind_executor(
+        ctx,
+        [&](auto ec, std::optional<value> v)
+        {
+            called++;
+            BOOST_CHECK(ec == oneshot::errc::broken_sender);
+            BOOST_CHECK(!v);
+        }));
+    s2 = {};
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(wait_op_too_large_for_buffer)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto called      = 0;
+    auto allocations = 0;
+
+    r.async_wait(asio::bind_executor(
+        ctx,
+        counted_handler{ &allocations,
+                         [&, big = std::array<char, 512>{}](auto ec)
+                         {
+                             called++;
+                             BOOST_CHECK(!ec);
+                             BOOST_CHECK_EQUAL(big.size(), 512);
+                         } }));
+
+    s.send("Hello");
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 1);
+}
+
+BOOST_AUTO_TEST_CASE(wait_op_in_place_outlives_state)
+{
+    auto ctx    = asio::io_context{};
+    auto called = 0;
+
+    {
+        auto [s, r] = oneshot::create<std::string>();
+        r.async_wait(
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                }));
+        s.send("Hello");
+    } // the completion is still pending
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(wait_op_buffer_free_after_cancellation)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto called      = 0;
+    auto allocations = 0;
+
+    auto cs = asio::cancellation_signal{};
+    r.async_wait(asio::bind_cancellation_slot(
+        cs.slot(),
+        asio::bind_executor(
+            ctx,
+            counted_handler{ &allocations,
+                             [&](auto ec)
+                             {
+                                 called++;
+                                 BOOST_CHECK_EQUAL(ec, oneshot::errc::cancelled);
+                             } })));
+
+    cs.emit(asio::cancellation_type::total);
+
+    // the cancelled operation has already given up the buffer
+    r.async_wait(asio::bind_executor(
+        ctx,
+        counted_handler{ &allocations,
+                         [&](auto ec)
+                         {
+                             called++;
+                             BOOST_CHECK(!ec);
+                         } }));
+
+    s.send("Hello");
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(partial_cancellation_then_wait_again)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto called      = 0;
+    auto allocations = 0;
+
+    auto cs = asio::cancellation_signal{};
+    r.async_wait(asio::bind_cancellation_slot(
+        cs.slot(),
+        asio::bind_executor(
+            ctx,
+            counted_handler{ &allocations,
+                             [&](auto ec)
+                             {
+                                 called++;
+                                 BOOST_CHECK_EQUAL(ec, oneshot::errc::cancelled);
+                                 BOOST_CHECK(!r.is_ready());
+
+                                 r.async_wait(asio::bind_executor(
+                                     ctx,
+                                     counted_handler{
+                                         &allocations,
+                                         [&](auto ec)
+                                         {
+                                             called++;
+                                             BOOST_CHECK(!ec);
+                                             BOOST_CHECK_EQUAL(r.get(), "Hello");
+                                         } }));
+                                 s.send("Hello");
+                             } })));
+
+    cs.emit(asio::cancellation_type::partial);
+    // the wait is gone, so emitting again does nothing
+    cs.emit(asio::cancellation_type::terminal);
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(cancellation_races_send)
+{
+    auto ctx       = asio::io_context{};
+    auto cancelled = 0;
+
+    for (auto i = 0; i < 1000; i++)
+    {
+        auto [s, r] = oneshot::create<int>();
+        auto cs     = asio::cancellation_signal{};
+        auto called = 0;
+        auto ready  = std::atomic<bool>{ false };
+        auto go     = std::atomic<bool>{ false };
+
+        r.async_wait(asio::bind_cancellation_slot(
+            cs.slot(),
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    cancelled += ec == oneshot::errc::cancelled;
+                    BOOST_CHECK(!ec || ec == oneshot::errc::cancelled);
+                })));
+
+        auto t = std::thread{ [&, s = std::move(s)]() mutable
+                              {
+                                  ready = true;
+                                  while (!go.load())
+                                      std::this_thread::yield();
+                                  s.send(i);
+                              } };
+        while (!ready.load())
+            std::this_thread::yield();
+        go = true;
+        // staggered, so that either side gets there first
+        for (auto spin = 0; spin < i % 8; spin++)
+            std::this_thread::yield();
+        cs.emit(asio::cancellation_type::terminal);
+        t.join();
+
+        // exactly one side completes the wait, the value is kept either way
+        ctx.run();
+        ctx.restart();
+        BOOST_CHECK_EQUAL(called, 1);
+        BOOST_CHECK_EQUAL(r.get(), i);
+    }
+
+    BOOST_TEST_MESSAGE(cancelled << " of 1000 waits were cancelled");
+}
+
+BOOST_AUTO_TEST_CASE(create_n_single_allocation)
+{
+    auto ctx         = asio::io_context{};
+    auto allocations = 0;
+    auto [ss, rs]    = oneshot::create_n<std::string>(
+        64, counting_allocator<std::string>{ &allocations });
+    auto called = 0;
+
+    BOOST_CHECK_EQUAL(allocations, 1);
+    BOOST_REQUIRE_EQUAL(ss.size(), 64);
+    BOOST_REQUIRE_EQUAL(rs.size(), 64);
+
+    for (auto& r : rs)
+        r.async_wait(
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                }));
+
+    for (auto i = 0; i < 64; i++)
+        ss[i].send(std::to_string(i));
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 64);
+    for (auto i = 0; i < 64; i++)
+        BOOST_CHECK_EQUAL(rs[i].get(), std::to_string(i));
+}
+
+BOOST_AUTO_TEST_CASE(create_n_outlives_ranges)
+{
+    auto [ss, rs] = oneshot::create_n<std::string>(3);
+
+    // the block is held until the last state is released
+    auto s = std::move(ss[1]);
+    auto r = std::move(rs[1]);
+    ss.clear();
+    rs.clear();
+
+    s.send("Hello");
+    BOOST_CHECK_EQUAL(r.get(), "Hello");
+
+    auto [es, er] = oneshot::create_n<int>(0);
+    BOOST_CHECK(es.empty());
+    BOOST_CHECK(er.empty());
+}
+
+BOOST_AUTO_TEST_CASE(wait_all)
+{
+    auto ctx         = asio::io_context{};
+    auto [ss, rs]    = oneshot::create_n<std::string>(3);
+    auto called      = 0;
+    auto allocations = 0;
+
+    oneshot::async_wait_all(
+        rs,
+        asio::bind_executor(
+            ctx,
+            counted_handler{ &allocations,
+                             [&](auto ec)
+                             {
+                                 called++;
+                                 BOOST_CHECK(!ec);
+                             } }));
+
+    ss[2].send("c");
+    ss[0].send("a");
+    ctx.poll();
+    BOOST_CHECK_EQUAL(called, 0);
+
+    ss[1].send("b");
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 1);
+    BOOST_CHECK_EQUAL(rs[0].get() + rs[1].get() + rs[2].get(), "abc");
+}
+
+BOOST_AUTO_TEST_CASE(wait_all_ready)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<void>(2);
+    auto called   = 0;
+
+    for (auto& s : ss)
+        s.send();
+
+    oneshot::async_wait_all(
+        rs,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(wait_all_broken_sender)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<int>(3);
+    auto called   = 0;
+
+    oneshot::async_wait_all(
+        rs,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+            }));
+
+    ss[1] = {};
+    ctx.run();
+    ctx.restart();
+    BOOST_CHECK_EQUAL(called, 1);
+
+    // the other receivers have been withdrawn
+    rs[0].async_wait(asio::bind_executor(ctx, [&](auto ec) { BOOST_CHECK(!ec); }));
+    ss[0].send(42);
+    ctx.run();
+    BOOST_CHECK_EQUAL(rs[0].get(), 42);
+}
+
+BOOST_AUTO_TEST_CASE(wait_any)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<std::string>(3);
+    auto called   = 0;
+
+    oneshot::async_wait_any(
+        rs,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec, std::size_t index)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(index, 1);
+            }));
+
+    ss[1].send("b");
+    ctx.run();
+    ctx.restart();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(rs[1].get(), "b");
+
+    // the losers can be waited on again
+    auto losers = std::array{ std::move(rs[0]), std::move(rs[2]) };
+    oneshot::async_wait_any(
+        losers,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec, std::size_t index)
+            {
+                called++;
+                BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+                BOOST_CHECK_EQUAL(index, 0);
+            }));
+
+    ss[0] = {};
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(wait_any_cancellation)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<int>(2);
+    auto called   = 0;
+
+    auto cs = asio::cancellation_signal{};
+    oneshot::async_wait_any(
+        rs,
+        asio::bind_cancellation_slot(
+            cs.slot(),
+            asio::bind_executor(
+                ctx,
+                [&](auto ec, std::size_t index)
+                {
+                    called++;
+                    BOOST_CHECK_EQUAL(ec, oneshot::errc::cancelled);
+                    BOOST_CHECK_EQUAL(index, 2);
+                })));
+
+    cs.emit(asio::cancellation_type::total);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(wait_all_cancellation_after_completion)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<int>(1);
+    auto called   = 0;
+
+    auto cs = asio::cancellation_signal{};
+    oneshot::async_wait_all(
+        rs,
+        asio::bind_cancellation_slot(
+            cs.slot(),
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                })));
+
+    ss[0].send(1);
+    // the completion has been posted, so this is too late to cancel
+    cs.emit(asio::cancellation_type::total);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(rs[0].get(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(wait_any_cross_thread)
+{
+    for (auto round = 0; round < 100; round++)
+    {
+        auto ctx      = asio::io_context{};
+        auto [ss, rs] = oneshot::create_n<int>(8);
+        auto called   = 0;
+
+        oneshot::async_wait_any(
+            rs,
+            asio::bind_executor(
+                ctx,
+                [&](auto ec, std::size_t index)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                    BOOST_CHECK_LT(index, 8);
+                }));
+
+        auto threads = std::vector<std::thread>{};
+        for (auto& s : ss)
+            threads.emplace_back([s = std::move(s)]() mutable { s.send(1); });
+        for (auto& t : threads)
+            t.join();
+
+        ctx.run();
+        BOOST_CHECK_EQUAL(called, 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reset)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    for (auto i = 0; i < 3; i++)
+    {
+        r.async_wait(
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec);
+                }));
+
+        s.send(std::to_string(i));
+        ctx.run();
+        ctx.restart();
+        BOOST_CHECK_EQUAL(r.get(), std::to_string(i));
+
+        s = r.reset();
+        BOOST_CHECK(!r.is_ready());
+    }
+
+    BOOST_CHECK_EQUAL(called, 3);
+}
+
+BOOST_AUTO_TEST_CASE(reset_unready)
+{
+    auto [s, r] = oneshot::create<std::string>();
+
+    BOOST_CHECK_EXCEPTION(
+        r.reset(),
+        oneshot::error,
+        [](const auto& e) { return e.code() == oneshot::errc::unready; });
+}
+
+BOOST_AUTO_TEST_CASE(reset_broken_sender)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    s = {};
+    s = r.reset();
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    s.send("Hello");
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(r.get(), "Hello");
+}
+
+BOOST_AUTO_TEST_CASE(reset_destroys_value)
+{
+    auto value  = std::make_shared<int>(42);
+    auto [s, r] = oneshot::local::create<std::shared_ptr<int>>();
+
+    s.send(value);
+    BOOST_CHECK_EQUAL(value.use_count(), 2);
+
+    s = r.reset();
+    BOOST_CHECK_EQUAL(value.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(broadcast)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create_broadcast<std::string>();
+    auto order  = std::vector<int>{};
+
+    for (auto i = 0; i < 3; i++)
+    {
+        auto copy = r;
+        copy.async_wait(
+            asio::bind_executor(
+                ctx,
+                [&, i, copy](auto ec)
+                {
+                    order.push_back(i);
+                    BOOST_CHECK(!ec);
+                    BOOST_CHECK_EQUAL(copy.get(), "Hello");
+                    BOOST_CHECK_EQUAL(&copy.get(), &r.get());
+                }));
+    }
+
+    BOOST_CHECK(!r.is_ready());
+    s.send("Hello");
+    BOOST_CHECK(r.is_ready());
+
+    ctx.run();
+    BOOST_CHECK((order == std::vector{ 0, 1, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_wait_after_send)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create_broadcast<void>();
+    auto called = 0;
+
+    s.send();
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_broken_sender)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create_broadcast<int>();
+    auto called = 0;
+
+    for (auto i = 0; i < 2; i++)
+        r.async_wait(
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+                }));
+
+    s = {};
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EXCEPTION(
+        r.get(),
+        oneshot::error,
+        [](const auto& e) { return e.code() == oneshot::errc::unready; });
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_cancellation)
+{
+    auto ctx       = asio::io_context{};
+    auto [s, r]    = oneshot::create_broadcast<int>();
+    auto cancelled = 0;
+    auto called    = 0;
+
+    auto cs = asio::cancellation_signal{};
+    r.async_wait(asio::bind_cancellation_slot(
+        cs.slot(),
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                cancelled++;
+                BOOST_CHECK_EQUAL(ec, oneshot::errc::cancelled);
+            })));
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    cs.emit(asio::cancellation_type::total);
+    ctx.poll();
+    BOOST_CHECK_EQUAL(cancelled, 1);
+
+    s.send(42);
+    ctx.run();
+    BOOST_CHECK_EQUAL(cancelled, 1);
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_cancellation_unlinks_waits)
+{
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create_broadcast<int>();
+    auto allocations = 0;
+    auto outstanding = 0;
+    auto cancelled   = 0;
+
+    for (auto i = 0; i < 100; i++)
+    {
+        auto cs = asio::cancellation_signal{};
+        r.async_wait(asio::bind_cancellation_slot(
+            cs.slot(),
+            asio::bind_executor(
+                ctx,
+                counted_handler{ &allocations,
+                                 [&](auto ec)
+                                 {
+                                     cancelled++;
+                                     BOOST_CHECK_EQUAL(
+                                         ec, oneshot::errc::cancelled);
+                                 },
+                                 &outstanding })));
+        cs.emit(asio::cancellation_type::total);
+        ctx.poll();
+        ctx.restart();
+
+        // no send walks the list, the cancelled wait has unlinked itself
+        BOOST_CHECK_EQUAL(outstanding, 0);
+    }
+    BOOST_CHECK_EQUAL(cancelled, 100);
+    BOOST_CHECK_EQUAL(allocations, 100);
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_cross_thread)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create_broadcast<std::string>();
+    auto called = std::atomic<int>{ 0 };
+
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0; i < 4; i++)
+        threads.emplace_back(
+            [&, r = r]
+            {
+                for (auto j = 0; j < 100; j++)
+                    r.async_wait(asio::bind_executor(
+                        ctx, [&](auto ec) { called += !ec; }));
+            });
+
+    threads.emplace_back([&, s = std::move(s)]() mutable { s.send("Hello"); });
+    for (auto& t : threads)
+        t.join();
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 400);
+}
+
+BOOST_AUTO_TEST_CASE(broadcast_cancellation_cross_thread)
+{
+    for (auto round = 0; round < 20; round++)
+    {
+        auto ctx       = asio::io_context{};
+        auto [s, r]    = oneshot::create_broadcast<std::string>();
+        auto called    = std::atomic<int>{ 0 };
+        auto cancelled = std::atomic<int>{ 0 };
+        // the slots are cleared by the completions
+        auto signals = std::vector<asio::cancellation_signal>(400);
+
+        auto threads = std::vector<std::thread>{};
+        for (auto i = 0; i < 4; i++)
+            threads.emplace_back(
+                [&, r = r, i]
+                {
+                    for (auto j = 0; j < 100; j++)
+                    {
+                        auto& cs = signals[i * 100 + j];
+                        r.async_wait(asio::bind_cancellation_slot(
+                            cs.slot(),
+                            asio::bind_executor(
+                                ctx,
+                                [&](auto ec)
+                                {
+                                    if (ec == oneshot::errc::cancelled)
+                                        cancelled++;
+                                    else if (!ec)
+                                        called++;
+                                })));
+                        if (j % 2)
+                            cs.emit(asio::cancellation_type::total);
+                    }
+                });
+
+        threads.emplace_back([&, s = std::move(s)]() mutable
+                             { s.send("Hello"); });
+        for (auto& t : threads)
+            t.join();
+
+        ctx.run();
+        BOOST_CHECK_EQUAL(called + cancelled, 400);
+        BOOST_CHECK_LE(cancelled, 200);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(try_extract)
+{
+    auto [s, r] = oneshot::create<std::unique_ptr<int>>();
+    auto ec     = oneshot::error_code{};
+
+    BOOST_CHECK(!r.try_extract(ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::unready);
+
+    s.send(std::make_unique<int>(42));
+
+    auto value = r.try_extract(ec);
+    BOOST_CHECK(!ec);
+    BOOST_REQUIRE(value && *value);
+    BOOST_CHECK_EQUAL(**value, 42);
+
+    // the receiver has released the state
+    BOOST_CHECK(!r.try_extract(ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::no_state);
+    BOOST_CHECK_EXCEPTION(
+        r.try_extract(),
+        oneshot::error,
+        [](const auto& e) { return e.code() == oneshot::errc::no_state; });
+}
+
+BOOST_AUTO_TEST_CASE(try_extract_broken_sender)
+{
+    auto [s, r] = oneshot::create<std::string>();
+    auto ec     = oneshot::error_code{};
+
+    s = {};
+
+    BOOST_CHECK(!r.try_extract());
+    BOOST_CHECK(!r.try_extract(ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+}
+
+BOOST_AUTO_TEST_CASE(try_wait)
+{
+    auto [s, r] = oneshot::create<void>();
+    auto ec     = oneshot::error_code{};
+
+    BOOST_CHECK(!r.try_wait());
+    BOOST_CHECK(!r.try_wait(ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::unready);
+
+    s.send();
+
+    BOOST_CHECK(r.try_wait());
+    BOOST_CHECK(r.try_wait(ec));
+    BOOST_CHECK(!ec);
+}
+
+BOOST_AUTO_TEST_CASE(blocking_wait)
+{
+    for (auto i = 0; i < 100; i++)
+    {
+        auto [s, r] = oneshot::create<std::string>();
+
+        auto t = std::thread{ [s = std::move(s)]() mutable { s.send("Hello"); } };
+        r.wait();
+        BOOST_CHECK_EQUAL(r.get(), "Hello");
+        t.join();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blocking_wait_broken_sender)
+{
+    auto [s, r] = oneshot::create<std::string>();
+    auto ec     = oneshot::error_code{};
+
+    auto t = std::thread{ [s = std::move(s)] {} };
+    BOOST_CHECK(!r.wait(ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::broken_sender);
+    t.join();
+}
+
+BOOST_AUTO_TEST_CASE(blocking_wait_for)
+{
+    using namespace std::chrono_literals;
+
+    auto [s, r] = oneshot::create<int>();
+    auto ec     = oneshot::error_code{};
+
+    BOOST_CHECK(!r.wait_for(1ms));
+    BOOST_CHECK(!r.wait_for(1ms, ec));
+    BOOST_CHECK_EQUAL(ec, oneshot::errc::timeout);
+
+    auto t = std::thread{ [s = std::move(s)]() mutable { s.send(42); } };
+    BOOST_CHECK(r.wait_for(10s, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(r.get(), 42);
+    t.join();
+
+    // settled already
+    BOOST_CHECK(r.wait_until(std::chrono::steady_clock::now()));
+}
+
+BOOST_AUTO_TEST_CASE(create_padded)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>(oneshot::padded);
+    auto called = 0;
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    s.send("Hello");
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(r.get(), "Hello");
+}
+
+BOOST_AUTO_TEST_CASE(create_n_padded)
+{
+    auto allocations = 0;
+    auto [ss, rs]    = oneshot::create_n<int>(
+        8, oneshot::padded, counting_allocator<int>{ &allocations });
+
+    BOOST_CHECK_EQUAL(allocations, 1);
+    for (auto i = 0; i < 8; i++)
+    {
+        ss[i].send(i);
+        BOOST_CHECK_EQUAL(rs[i].get(), i);
+
+        // every value lives on its own cache line
+        auto address = reinterpret_cast<std::uintptr_t>(&rs[i].get());
+        if (i > 0)
+            BOOST_CHECK_GE(
+                address - reinterpret_cast<std::uintptr_t>(&rs[i - 1].get()),
+                ONESHOT_CACHE_LINE_SIZE);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(packed_value)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<status>();
+    auto called = 0;
+
+    static_assert(std::is_same_v<decltype(r.get()), status>);
+
+    r.async_wait(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK(r.get() == status::failed);
+            }));
+
+    s.send(status::failed);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+
+    auto [s2, r2] = oneshot::create<letters>();
+    s2.send(letters{ 'a', 'b', 'c', 'd', 'e', 'f', 'g' });
+    BOOST_CHECK_EQUAL(std::string(r2.get().data(), 7), "abcdefg");
+    BOOST_CHECK(r2.try_extract().has_value());
+
+    // without opting in, the value is stored and referenced as usual
+    auto [s3, r3] = oneshot::create<int>();
+    static_assert(std::is_same_v<decltype(r3.get()), int&>);
+    s3.send(1);
+    r3.get() = 2;
+    BOOST_CHECK_EQUAL(r3.get(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(packed_value_async_extract)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<status>();
+    auto called = 0;
+
+    std::move(r).async_extract(
+        asio::bind_executor(
+            ctx,
+            [&](auto ec, status value)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+                BOOST_CHECK(value == status::ok);
+            }));
+
+    s.send(status::ok);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(co_await_receiver)
+{
+    auto [s, r] = oneshot::create<std::string>();
+    auto value  = std::string{};
+
+    [](auto r, auto& value) -> task
+    { value = co_await std::move(r); }(std::move(r), value);
+
+    BOOST_CHECK(value.empty());
+    s.send("value");
+    BOOST_CHECK_EQUAL(value, "value");
+
+    auto [s2, r2] = oneshot::create<status>();
+    s2.send(status::failed);
+    auto packed = status::ok;
+    [](auto r, auto& value) -> task
+    { value = co_await std::move(r); }(std::move(r2), packed);
+    BOOST_CHECK(packed == status::failed);
+}
+
+BOOST_AUTO_TEST_CASE(co_await_receiver_broken_sender)
+{
+    auto [s, r] = oneshot::create<void>();
+    auto ec     = oneshot::error_code{};
+
+    [](auto r, auto& ec) -> task
+    {
+        try
+        {
+            co_await std::move(r);
+        }
+        catch (const oneshot::error& e)
+        {
+            ec = e.code();
+        }
+    }(std::move(r), ec);
+
+    BOOST_CHECK(!ec);
+    s = {};
+    BOOST_CHECK(ec == oneshot::errc::broken_sender);
+}
+
+BOOST_AUTO_TEST_CASE(co_await_receiver_cross_thread)
+{
+    auto [s, r] = oneshot::create<std::string>();
+    auto value  = std::string{};
+
+    [](auto r, auto& value) -> task
+    { value = co_await std::move(r); }(std::move(r), value);
+
+    std::thread{ [s = std::move(s)]() mutable { s.send("value"); } }.join();
+    BOOST_CHECK_EQUAL(value, "value");
+}
+
+BOOST_AUTO_TEST_CASE(batched_send)
+{
+    auto ctx1    = asio::io_context{};
+    auto ctx2    = asio::io_context{};
+    auto called  = 0;
+    auto handler = [&](auto ec)
+    {
+        called++;
+        BOOST_CHECK(!ec);
+    };
+
+    auto [ss, rs] = oneshot::create_n<std::string>(4);
+    rs[0].async_wait(asio::bind_executor(ctx1, handler));
+    rs[1].async_wait(asio::bind_executor(ctx1, handler));
+    rs[2].async_wait(asio::bind_executor(ctx1, handler));
+    rs[3].async_wait(asio::bind_executor(ctx2, handler));
+
+    {
+        auto batch = oneshot::send_batch{};
+        for (auto& s : ss)
+            batch.send(s, "Hello");
+
+        BOOST_CHECK_EQUAL(ctx1.poll(), 0);
+        BOOST_CHECK_EQUAL(ctx2.poll(), 0);
+    }
+
+    // a single function per executor
+    BOOST_CHECK_EQUAL(ctx1.poll(), 1);
+    BOOST_CHECK_EQUAL(ctx2.poll(), 1);
+    BOOST_CHECK_EQUAL(called, 4);
+    for (auto& r : rs)
+        BOOST_CHECK_EQUAL(r.get(), "Hello");
+}
+
+BOOST_AUTO_TEST_CASE(batched_send_context_shutdown)
+{
+    auto [ss, rs] = oneshot::create_n<int>(2);
+    auto resource = std::make_shared<int>();
+
+    {
+        auto ctx = asio::io_context{};
+        for (auto& r : rs)
+            r.async_wait(asio::bind_executor(
+                ctx, [resource](auto) { BOOST_FAIL("handler invoked"); }));
+
+        auto batch = oneshot::send_batch{};
+        for (auto& s : ss)
+            batch.send(s, 42);
+        batch.flush();
+        BOOST_CHECK_EQUAL(resource.use_count(), 3);
+    }
+
+    // the posted completions are destroyed along with the context
+    BOOST_CHECK_EQUAL(resource.use_count(), 1);
+    for (auto& r : rs)
+        BOOST_CHECK_EQUAL(r.get(), 42);
+}
+
+BOOST_AUTO_TEST_CASE(batched_send_unwinding)
+{
+    auto ctx      = asio::io_context{};
+    auto [ss, rs] = oneshot::create_n<int>(2);
+    auto called   = 0;
+
+    for (auto& r : rs)
+        r.async_wait(asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+
+    try
+    {
+        auto batch = oneshot::send_batch{};
+        for (auto& s : ss)
+            batch.send(s, 42);
+        throw std::runtime_error{ "unwinding" };
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // the batch is flushed on destruction
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(batched_send_without_waits)
+{
+    auto [s, r] = oneshot::create<int>();
+    auto batch  = oneshot::send_batch{};
+
+    batch.send(s, 42);
+    BOOST_CHECK_EQUAL(r.get(), 42);
+    BOOST_CHECK_EXCEPTION(
+        batch.send(s, 42),
+        oneshot::error,
+        [](const auto& e) { return e.code() == oneshot::errc::no_state; });
+}
+
+BOOST_AUTO_TEST_CASE(async_wait_for_timeout)
+{
+    using namespace std::chrono_literals;
+
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    r.async_wait_for(
+        1ms,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(ec == oneshot::errc::timeout);
+            }));
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+
+    // the state can be waited on again
+    r.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(!ec);
+        }));
+    s.send("Hello");
+
+    ctx.restart();
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(r.get(), "Hello");
+}
+
+BOOST_AUTO_TEST_CASE(async_wait_until_before_deadline)
+{
+    using namespace std::chrono_literals;
+
+    auto ctx         = asio::io_context{};
+    auto [s, r]      = oneshot::create<std::string>();
+    auto allocations = 0;
+
+    // without captures the timed operation fits the in-place buffer
+    static auto called = 0;
+    called             = 0;
+    r.async_wait_until(
+        std::chrono::steady_clock::now() + 1h,
+        asio::bind_executor(
+            ctx,
+            counted_handler{ &allocations,
+                             [](auto ec)
+                             {
+                                 called++;
+                                 BOOST_CHECK(!ec);
+                             } }));
+    s.send("Hello");
+
+    // the shared timer is cancelled once no timed wait is left
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(async_extract_for_timeout)
+{
+    using namespace std::chrono_literals;
+
+    auto ctx    = asio::io_context{};
+    auto order  = std::vector<int>{};
+    auto [ss, rs] = oneshot::create_n<std::string>(4);
+
+    for (auto i : { 3, 1, 2 })
+    {
+        std::move(rs[i]).async_extract_for(
+            i * 5ms,
+            asio::bind_executor(
+                ctx,
+                [&, i](auto ec, std::string v)
+                {
+                    BOOST_CHECK(ec == oneshot::errc::timeout);
+                    BOOST_CHECK(v.empty());
+                    order.push_back(i);
+                }));
+    }
+
+    std::move(rs[0]).async_extract_for(
+        1h,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec, std::string v)
+            {
+                BOOST_CHECK(!ec);
+                BOOST_CHECK_EQUAL(v, "Hello");
+                order.push_back(0);
+            }));
+    ss[0].send("Hello");
+
+    ctx.run();
+    BOOST_CHECK((order == std::vector<int>{ 0, 1, 2, 3 }));
+}
+
+BOOST_AUTO_TEST_CASE(async_wait_for_cross_thread)
+{
+    using namespace std::chrono_literals;
+
+    auto ctx    = asio::io_context{};
+    auto called = 0;
+
+    for (auto i = 0; i < 100; i++)
+    {
+        auto [s, r] = oneshot::create<int>();
+        r.async_wait_for(
+            100us,
+            asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    called++;
+                    BOOST_CHECK(!ec || ec == oneshot::errc::timeout);
+                }));
+
+        auto t = std::thread{ [&, s = std::move(s)]() mutable
+                              {
+                                  std::this_thread::sleep_for(100us);
+                                  s.send(i);
+                              } };
+        ctx.restart();
+        ctx.run();
+        t.join();
+    }
+
+    BOOST_CHECK_EQUAL(called, 100);
+}
+
+BOOST_AUTO_TEST_CASE(async_wait_for_context_shutdown)
+{
+    using namespace std::chrono_literals;
+
+    auto [s1, r1] = oneshot::create<int>();
+    auto [s2, r2] = oneshot::create<void>();
+    auto resource = std::make_shared<int>();
+
+    {
+        auto ctx = asio::io_context{};
+        r1.async_wait_for(
+            1h,
+            asio::bind_executor(
+                ctx, [resource](auto) { BOOST_FAIL("handler invoked"); }));
+        r2.async_wait_for(
+            2h,
+            asio::bind_executor(
+                ctx, [resource](auto) { BOOST_FAIL("handler invoked"); }));
+        BOOST_CHECK_EQUAL(resource.use_count(), 3);
+    }
+    BOOST_CHECK_EQUAL(resource.use_count(), 1);
+
+    // the receivers can be waited on again
+    auto ctx    = asio::io_context{};
+    auto called = 0;
+    r1.async_wait_for(
+        1h,
+        asio::bind_executor(
+            ctx,
+            [&](auto ec)
+            {
+                called++;
+                BOOST_CHECK(!ec);
+            }));
+    s1.send(42);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(r1.get(), 42);
+
+    s2.send();
+    BOOST_CHECK(r2.is_ready());
+}
+
+BOOST_AUTO_TEST_CASE(then)
+{
+    auto ctx    = asio::io_context{};
+    auto [s, r] = oneshot::create<std::string>();
+    auto called = 0;
+
+    auto r2 = std::move(r)
+                  .then([](std::string v) { return v.size(); })
+                  .then([](std::size_t n) { return std::to_string(n * 2); });
+
+    r2.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(!ec);
+        }));
+
+    s.send("Hello");
+    BOOST_CHECK(r2.is_ready());
+    BOOST_CHECK_EQUAL(r2.get(), "10");
+
+    // the whole chain costs a single completion
+    BOOST_CHECK_EQUAL(ctx.poll(), 1);
+    BOOST_CHECK_EQUAL(called, 1);
+}
+
+BOOST_AUTO_TEST_CASE(then_after_send)
+{
+    auto [s, r] = oneshot::create<int>();
+    s.send(20);
+
+    auto r2 = std::move(r).then([](int v) { return v + 1; });
+    BOOST_CHECK_EQUAL(r2.get(), 21);
+
+    auto [s3, r3] = oneshot::create<void>();
+    auto called   = 0;
+    auto r4       = std::move(r3).then([&] { called++; });
+    s3.send();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_NO_THROW(r4.wait());
+}
+
+BOOST_AUTO_TEST_CASE(then_broken_sender)
+{
+    auto ctx    = asio::io_context{};
+    auto called = 0;
+    auto [s, r] = oneshot::create<std::string>();
+    auto r2     = std::move(r).then([&](std::string v) { return v; });
+    s           = {};
+    r2.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(ec == oneshot::errc::broken_sender);
+        }));
+
+    auto [s3, r3] = oneshot::create<std::string>();
+    auto r4       = std::move(r3).then(
+        [](std::string) -> int { throw std::runtime_error{ "" }; });
+    BOOST_CHECK_NO_THROW(s3.send("Hello"));
+    r4.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(ec == oneshot::errc::broken_sender);
+        }));
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+}
+
+BOOST_AUTO_TEST_CASE(then_cross_thread)
+{
+    auto [s, r]  = oneshot::create<std::string>();
+    auto id      = std::thread::id{};
+    auto r2      = std::move(r).then(
+        [&](std::string v)
+        {
+            id = std::this_thread::get_id();
+            return v + "!";
+        });
+    auto t = std::thread{ [s = std::move(s)]() mutable { s.send("Hello"); } };
+    auto sender_id = t.get_id();
+
+    r2.wait();
+    BOOST_CHECK_EQUAL(r2.get(), "Hello!");
+    t.join();
+    BOOST_CHECK(id == sender_id);
+}
+
+BOOST_AUTO_TEST_CASE(latch)
+{
+    auto ctx         = asio::io_context{};
+    auto allocations = 0;
+    auto called      = 0;
+    auto [s, r] =
+        oneshot::create_latch(counting_allocator<std::size_t>{ &allocations });
+
+    auto senders = std::vector<oneshot::latch_sender<>>(3, s);
+    senders.push_back(std::move(s));
+
+    r.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(!ec);
+        }));
+
+    senders[0].send();
+    senders[1].send();
+    senders.pop_back();
+    BOOST_CHECK(!r.is_ready());
+
+    senders[2].send();
+    BOOST_CHECK(r.is_ready());
+    BOOST_CHECK_EQUAL(r.get(), 1); // the destroyed one
+
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(allocations, 1);
+}
+
+BOOST_AUTO_TEST_CASE(latch_cross_thread)
+{
+    auto [s, r]   = oneshot::create_latch();
+    auto threads  = std::vector<std::thread>{};
+    auto finished = std::atomic<int>{};
+
+    for (auto i = 0; i < 8; i++)
+        threads.emplace_back(
+            [&finished, s]() mutable
+            {
+                finished++;
+                if (finished % 2)
+                    s.send();
+            });
+    s.send();
+
+    r.wait();
+    BOOST_CHECK_EQUAL(finished, 8);
+    BOOST_CHECK_LE(r.get(), 8);
+    for (auto& t : threads)
+        t.join();
+}
+
+BOOST_AUTO_TEST_CASE(latch_receiver_destroyed_first)
+{
+    auto allocations = 0;
+    auto outstanding = 0;
+
+    for (auto last_sends : { false, true })
+    {
+        auto senders = std::vector<oneshot::latch_sender<>>{};
+        {
+            auto [s, r] = oneshot::create_latch(
+                counting_allocator<std::size_t>{ &allocations, &outstanding });
+            senders.assign(3, s);
+            senders.push_back(std::move(s));
+        }
+
+        senders[0].send();
+        senders.erase(senders.begin() + 1);
+        BOOST_CHECK_EQUAL(outstanding, 1);
+
+        // the last arrival frees the block it arrives on
+        if (last_sends)
+        {
+            senders[1].send();
+            senders[2].send();
+        }
+        senders.clear();
+        BOOST_CHECK_EQUAL(outstanding, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ordered_ring_in_order)
+{
+    auto ctx         = asio::io_context{};
+    auto allocations = 0;
+    auto ring        = oneshot::ordered_ring<std::string, 3>{
+        counting_allocator<std::string>{ &allocations }
+    };
+    auto received = std::vector<std::string>{};
+
+    for (auto round = 0; round < 4; round++)
+    {
+        auto ss = std::vector<oneshot::sender<std::string>>{};
+        while (auto s = ring.try_push())
+            ss.push_back(std::move(*s));
+        BOOST_CHECK(ring.full());
+        BOOST_CHECK_EQUAL(ss.size(), 3);
+
+        // completed out of order
+        ss[2].send("c");
+        ss[0].send("a");
+        ss[1].send("b");
+
+        while (!ring.empty())
+        {
+            ring.async_wait_front(asio::bind_executor(
+                ctx,
+                [&](auto ec)
+                {
+                    BOOST_CHECK(!ec);
+                    received.push_back(ring.front().get());
+                    ring.pop();
+                }));
+            ctx.run();
+            ctx.restart();
+        }
+    }
+
+    BOOST_CHECK_EQUAL(received.size(), 12);
+    for (auto i = 0; i < 12; i++)
+        BOOST_CHECK_EQUAL(received[i], std::string(1, "abc"[i % 3]));
+    BOOST_CHECK_EQUAL(allocations, 1);
+}
+
+BOOST_AUTO_TEST_CASE(ordered_ring_broken_sender)
+{
+    auto ring = oneshot::ordered_ring<int, 2>{};
+    auto s1   = ring.try_push();
+    auto s2   = ring.try_push();
+    BOOST_CHECK(!ring.try_push());
+
+    s1.reset();
+    s2->send(2);
+
+    auto ec = oneshot::error_code{};
+    BOOST_CHECK(!ring.front().try_wait(ec));
+    BOOST_CHECK(ec == oneshot::errc::broken_sender);
+    ring.pop();
+    BOOST_CHECK_EQUAL(ring.front().get(), 2);
+    ring.pop();
+    BOOST_CHECK(ring.empty());
+    BOOST_CHECK_THROW(ring.pop(), oneshot::error);
+}
+
+BOOST_AUTO_TEST_CASE(ordered_ring_waits_in_place)
+{
+    auto ctx         = asio::io_context{};
+    auto ring        = oneshot::ordered_ring<std::string, 4>{};
+    auto allocations = 0;
+    auto outstanding = 0;
+    auto received    = 0;
+
+    for (auto round = 0; round < 8; round++)
+    {
+        auto ss = std::vector<oneshot::sender<std::string>>{};
+        while (auto s = ring.try_push())
+            ss.push_back(std::move(*s));
+
+        while (!ring.empty())
+        {
+            ring.async_wait_front(asio::bind_executor(
+                ctx,
+                counted_handler{ &allocations,
+                                 [&](auto ec)
+                                 {
+                                     BOOST_CHECK(!ec);
+                                     received++;
+                                     ring.pop();
+                                 },
+                                 &outstanding }));
+            ss[received % 4].send("reply");
+            ctx.run();
+            ctx.restart();
+        }
+    }
+
+    BOOST_CHECK_EQUAL(received, 32);
+    BOOST_CHECK_EQUAL(allocations, 0);
+    BOOST_CHECK_EQUAL(outstanding, 0);
+}
+
+BOOST_AUTO_TEST_CASE(arena_waits_share_buffer)
+{
+    auto ctx         = asio::io_context{};
+    auto allocations = 0;
+    auto outstanding = 0;
+    auto called      = 0;
+
+    {
+        auto [ss, rs] = oneshot::create_n<int>(
+            2, counting_allocator<int>{ &allocations, &outstanding });
+
+        // the second wait finds the shared buffer taken
+        for (auto& r : rs)
+            r.async_wait(asio::bind_executor(
+                ctx,
+                counted_handler{ &allocations,
+                                 [&](auto ec)
+                                 { called += ec == oneshot::errc::broken_sender; },
+                                 &outstanding }));
+        BOOST_CHECK_EQUAL(allocations, 2);
+
+        ss.clear();
+        ctx.run();
+    }
+
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(outstanding, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(emplace_with)
+{
+    struct pinned
+    {
+        int value;
+
+        explicit pinned(int v)
+            : value{ v }
+        {
+        }
+
+        pinned(const pinned&) = delete;
+    };
+
+    {
+        auto [s, r] = oneshot::create<pinned>();
+        s.emplace_with([] { return pinned{ 42 }; });
+        BOOST_CHECK_EQUAL(r.get().value, 42);
+        BOOST_CHECK_THROW(
+            s.emplace_with([] { return pinned{ 1 }; }), oneshot::error);
+    }
+
+    {
+        auto [s, r] = oneshot::create<int>();
+        s.emplace_with([] { return 42; });
+        BOOST_CHECK_EQUAL(r.get(), 42);
+    }
+
+    {
+        auto [s, r] = oneshot::create<void>();
+        s.emplace_with([] {});
+        BOOST_CHECK(r.is_ready());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fill_with)
+{
+    {
+        auto [s, r] = oneshot::create<std::vector<int>>();
+        s.fill_with([](std::vector<int>& v) { v.assign(1024, 7); });
+        BOOST_CHECK_EQUAL(r.get().size(), 1024);
+        BOOST_CHECK_EQUAL(r.get()[1023], 7);
+    }
+
+    {
+        auto [s, r] = oneshot::create<int>();
+        s.fill_with([](int& v) { v = 42; });
+        BOOST_CHECK_EQUAL(r.get(), 42);
+    }
+
+    {
+        auto [s, r] = oneshot::create<std::string>();
+        BOOST_CHECK_THROW(
+            s.fill_with(
+                [](std::string& v)
+                {
+                    v = "partial";
+                    throw std::runtime_error{ "fill" };
+                }),
+            std::runtime_error);
+        BOOST_CHECK(!r.is_ready());
+
+        s.fill_with([](std::string& v) { v = "value"; });
+        BOOST_CHECK_EQUAL(r.get(), "value");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bulk)
+{
+    auto ctx         = asio::io_context{};
+    auto allocations = 0;
+    auto called      = 0;
+    auto [ss, r] =
+        oneshot::create_bulk<int>(100, counting_allocator<int>{ &allocations });
+    BOOST_CHECK_EQUAL(allocations, 1);
+    BOOST_CHECK_EQUAL(r.size(), 100);
+
+    r.async_wait(asio::bind_executor(
+        ctx,
+        [&](auto ec)
+        {
+            called++;
+            BOOST_CHECK(!ec);
+        }));
+
+    for (auto i = 99; i > 0; i--)
+        ss[i].send(i * 2);
+    BOOST_CHECK_EQUAL(r.settled(), 99);
+    BOOST_CHECK(!r.is_ready(0));
+    BOOST_CHECK_THROW(r.get(0), oneshot::error);
+    BOOST_CHECK_THROW(r.values(), oneshot::error);
+
+    ctx.poll();
+    BOOST_CHECK_EQUAL(called, 0);
+
+    ss[0].send(0);
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+    BOOST_CHECK_EQUAL(r.get(42), 84);
+
+    auto sum = 0;
+    for (auto v : r.values())
+        sum += v;
+    BOOST_CHECK_EQUAL(sum, 99 * 100);
+}
+
+BOOST_AUTO_TEST_CASE(bulk_next_settled)
+{
+    auto ctx     = asio::io_context{};
+    auto [ss, r] = oneshot::create_bulk<std::string>(3);
+    auto called  = 0;
+    auto handler = [&](auto ec)
+    {
+        called++;
+        BOOST_CHECK(!ec);
+    };
+
+    r.async_wait_settled(r.settled() + 1, asio::bind_executor(ctx, handler));
+    ss[1].send("one");
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 1);
+
+    r.async_wait_settled(r.settled() + 1, asio::bind_executor(ctx, handler));
+    ss[2] = {};
+    ctx.restart();
+    ctx.run();
+    BOOST_CHECK_EQUAL(called, 2);
+    BOOST_CHECK_EQUAL(r.settled(), 2);
+
+    auto ready = std::vector<std::size_t>{};
+    r.for_each_ready(
+        [&](std::size_t index, std::string& value)
+        {
+            ready.push_back(index);
+            BOOST_CHECK_EQUAL(value, "one");
+        });
+    BOOST_CHECK(ready == std::vector<std::size_t>{ 1 });
+}
+
+BOOST_AUTO_TEST_CASE(bulk_cross_thread)
+{
+    auto ctx     = asio::io_context{};
+    auto [ss, r] = oneshot::create_bulk<std::size_t>(1000);
+    auto called  = 0;
+    auto threads = std::vector<std::thread>{};
+    r.async_wait(asio::bind_executor(ctx, [&](auto) { called++; }));
+
+    for (auto t = 0; t < 4; t++)
+        threads.emplace_back(
+            [&, t]
+            {
+                for (auto i = std::size_t(t); i < ss.size(); i += 4)
+                    ss[i].send(i);
+            });
+
+    ctx.run();
+    for (auto& t : threads)
+        t.join();
+    BOOST_CHECK_EQUAL(called, 1);
+    for (auto i = std::size_t{ 0 }; i < 1000; i++)
+        BOOST_CHECK_EQUAL(r.get(i), i);
+}
+
+#ifdef ONESHOT_HAS_EVENTFD
+BOOST_AUTO_TEST_CASE(watch_readiness)
+{
+    auto notifier = oneshot::readiness_notifier{};
+    auto [s1, r1] = oneshot::create<int>();
+    auto [s2, r2] = oneshot::create<std::string>();
+    auto [s3, r3] = oneshot::create<void>();
+    auto tags     = std::vector<std::uint64_t>{};
+    auto collect  = [&](std::uint64_t tag) { tags.push_back(tag); };
+
+    s1.send(42);
+    notifier.watch(r1, 1);
+    notifier.watch(r2, 2);
+    notifier.watch(r3, 3);
+    BOOST_CHECK_THROW(notifier.watch(r2, 4), oneshot::error);
+
+    auto pfd = pollfd{ notifier.native_handle(), POLLIN, 0 };
+    BOOST_CHECK_EQUAL(::poll(&pfd, 1, 0), 1);
+    BOOST_CHECK_EQUAL(notifier.consume(collect), 1);
+    BOOST_CHECK(tags == std::vector<std::uint64_t>{ 1 });
+    BOOST_CHECK_EQUAL(::poll(&pfd, 1, 0), 0);
+
+    s2.send("value");
+    s3 = {};
+    BOOST_CHECK_EQUAL(::poll(&pfd, 1, 0), 1);
+    BOOST_CHECK_EQUAL(notifier.consume(collect), 2);
+    BOOST_CHECK((tags == std::vector<std::uint64_t>{ 1, 2, 3 }));
+    BOOST_CHECK_EQUAL(r1.get(), 42);
+    BOOST_CHECK_EQUAL(r2.get(), "value");
+}
+
+BOOST_AUTO_TEST_CASE(watch_readiness_cross_thread)
+{
+    constexpr auto count = 1000;
+
+    auto notifier  = oneshot::readiness_notifier{};
+    auto senders   = std::vector<oneshot::sender<int>>{};
+    auto receivers = std::vector<oneshot::receiver<int>>{};
+    for (auto i = 0; i < count; i++)
+    {
+        auto [s, r] = oneshot::create<int>();
+        senders.push_back(std::move(s));
+        receivers.push_back(std::move(r));
+        notifier.watch(receivers.back(), i);
+    }
+
+    auto t = std::thread{ [&]
+                          {
+                              for (auto i = 0; i < count; i++)
+                                  senders[i].send(i);
+                          } };
+
+    auto seen = std::vector<bool>(count);
+    auto pfd  = pollfd{ notifier.native_handle(), POLLIN, 0 };
+    for (auto consumed = std::size_t{ 0 }; consumed < count;)
+    {
+        BOOST_REQUIRE_EQUAL(::poll(&pfd, 1, 5000), 1);
+        consumed += notifier.consume(
+            [&](std::uint64_t tag)
+            {
+                BOOST_CHECK(!seen[tag]);
+                seen[tag] = true;
+                BOOST_CHECK_EQUAL(receivers[tag].get(), static_cast<int>(tag));
+            });
+    }
+    t.join();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2022 Mohammad Nejati
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at https://www.boost.org/LICENSE_1_0.txt)
+
+#include <oneshot_stdexec.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+#include <type_traits>
+
+BOOST_AUTO_TEST_SUITE(stdexec_extract)
+
+BOOST_AUTO_TEST_CASE(sent_value)
+{
+    auto [s, r] = oneshot::create<std::string>();
+    s.send("Hello");
+
+    auto result = stdexec::sync_wait(oneshot::exec::extract(std::move(r)));
+    BOOST_REQUIRE(result);
+    BOOST_CHECK_EQUAL(std::get<0>(*result), "Hello");
+}
+
+BOOST_AUTO_TEST_CASE(sent_from_another_thread)
+{
+    auto [s, r] = oneshot::create<int>();
+    auto t      = std::thread{ [s = std::move(s)]() mutable { s.send(42); } };
+
+    auto result = stdexec::sync_wait(oneshot::exec::extract(std::move(r)));
+    t.join();
+    BOOST_REQUIRE(result);
+    BOOST_CHECK_EQUAL(std::get<0>(*result), 42);
+}
+
+BOOST_AUTO_TEST_CASE(sent_void)
+{
+    auto [s, r] = oneshot::create<void>();
+    s.send();
+
+    BOOST_CHECK(stdexec::sync_wait(oneshot::exec::extract(std::move(r))));
+}
+
+BOOST_AUTO_TEST_CASE(broken_sender)
+{
+    auto [s, r] = oneshot::create<int>();
+    s           = {};
+
+    auto ec     = oneshot::error_code{};
+    auto result = stdexec::sync_wait(
+        oneshot::exec::extract(std::move(r)) |
+        stdexec::upon_error(
+            [&](auto e)
+            {
+                if constexpr (std::is_same_v<decltype(e), oneshot::error_code>)
+                    ec = e;
+                return -1;
+            }));
+    BOOST_REQUIRE(result);
+    BOOST_CHECK_EQUAL(std::get<0>(*result), -1);
+    BOOST_CHECK(ec == oneshot::errc::broken_sender);
+}
+
+BOOST_AUTO_TEST_CASE(stop_requested)
+{
+    auto [s, r] = oneshot::create<int>();
+
+    // when_all requests a stop on the pending wait once its sibling stops
+    auto result = stdexec::sync_wait(stdexec::when_all(
+        oneshot::exec::extract(std::move(r)), stdexec::just_stopped()));
+    BOOST_CHECK(!result);
+
+    // the value is released along with the state
+    BOOST_CHECK_NO_THROW(s.send(1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()